@@ -0,0 +1,157 @@
+/* Copyright (c) 2015-2018, EPFL/Blue Brain Project
+ * All rights reserved. Do not distribute without permission.
+ * Responsible Author: Cyrille Favreau <cyrille.favreau@epfl.ch>
+ *
+ * This file is part of Brayns <https://github.com/BlueBrain/Brayns>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "EventLevelsOfDetail.h"
+
+#include <algorithm>
+#include <limits>
+#include <mutex>
+#include <unordered_map>
+
+namespace brayns
+{
+namespace
+{
+// Number of cells along one axis of the first coarse level of detail
+const float LOD_BASE_RESOLUTION = 256.f;
+const size_t MAX_LOD_LEVELS = 8;
+
+// Coarser levels are not built once a level holds fewer clusters
+const size_t MIN_LOD_EVENTS = 64;
+
+std::mutex _publishedFrameMutex;
+EventLevelsOfDetail::Frame _publishedFrame;
+} // namespace
+
+EventLevelsOfDetail::EventLevelsOfDetail(const float* events,
+                                         const size_t nbEvents,
+                                         const std::vector<uint64_t>& intervals)
+{
+    if (nbEvents <= MIN_LOD_EVENTS || intervals.size() < 2)
+        return;
+
+    float lower[3];
+    float upper[3];
+    for (size_t j = 0; j < 3; ++j)
+    {
+        lower[j] = std::numeric_limits<float>::max();
+        upper[j] = -std::numeric_limits<float>::max();
+    }
+    for (size_t i = 0; i < nbEvents; ++i)
+        for (size_t j = 0; j < 3; ++j)
+        {
+            lower[j] = std::min(lower[j], events[i * 3 + j]);
+            upper[j] = std::max(upper[j], events[i * 3 + j]);
+        }
+    const float maxExtent =
+        std::max(upper[0] - lower[0],
+                 std::max(upper[1] - lower[1], upper[2] - lower[2]));
+    if (maxExtent <= 0.f)
+        return;
+
+    // Past the extent of the events, every interval is a single cluster
+    _levels.reserve(MAX_LOD_LEVELS);
+    const float* previousEvents = events;
+    const float* previousWeights = nullptr;
+    const std::vector<uint64_t>* previousIntervals = &intervals;
+    size_t nbPreviousEvents = nbEvents;
+    float cellSize = maxExtent / LOD_BASE_RESOLUTION;
+    while (_levels.size() + 1 < MAX_LOD_LEVELS && cellSize <= 2.f * maxExtent)
+    {
+        // Weighted centroids of the events of the previous level, per cell
+        // and per interval
+        Level level;
+        level.intervals.push_back(0);
+        for (size_t k = 0; k + 1 < previousIntervals->size(); ++k)
+        {
+            std::unordered_map<uint64_t, size_t> clusters;
+            for (size_t i = (*previousIntervals)[k];
+                 i < (*previousIntervals)[k + 1]; ++i)
+            {
+                const float* p = previousEvents + i * 3;
+                const float weight = previousWeights ? previousWeights[i] : 1.f;
+                uint64_t key = 0;
+                for (size_t j = 0; j < 3; ++j)
+                    key = (key << 21) |
+                          uint64_t((p[j] - lower[j]) / cellSize);
+                const auto it = clusters.insert({key, level.weights.size()});
+                if (it.second)
+                {
+                    level.events.insert(level.events.end(), 3, 0.f);
+                    level.weights.push_back(0.f);
+                }
+                const size_t index = it.first->second;
+                for (size_t j = 0; j < 3; ++j)
+                    level.events[index * 3 + j] += p[j] * weight;
+                level.weights[index] += weight;
+            }
+            level.intervals.push_back(level.weights.size());
+        }
+
+        // Levels that do not reduce the number of events by at least a
+        // quarter are not worth storing
+        cellSize *= 2.f;
+        if (level.weights.size() * 4 > nbPreviousEvents * 3)
+            continue;
+
+        for (size_t i = 0; i < level.weights.size(); ++i)
+            for (size_t j = 0; j < 3; ++j)
+                level.events[i * 3 + j] /= level.weights[i];
+
+        _levels.push_back(std::move(level));
+        previousEvents = _levels.back().events.data();
+        previousWeights = _levels.back().weights.data();
+        previousIntervals = &_levels.back().intervals;
+        nbPreviousEvents = _levels.back().weights.size();
+        if (nbPreviousEvents <= MIN_LOD_EVENTS)
+            break;
+    }
+}
+
+EventLevelsOfDetail::Clusters EventLevelsOfDetail::getClusters(
+    const size_t level, const size_t firstInterval,
+    const size_t lastInterval) const
+{
+    Clusters clusters;
+    if (level == 0 || level > _levels.size())
+        return clusters;
+
+    const Level& lod = _levels[level - 1];
+    const size_t last = std::min(lastInterval, lod.intervals.size() - 1);
+    const size_t first = std::min(firstInterval, last);
+    const uint64_t begin = lod.intervals[first];
+    clusters.events = lod.events.data() + begin * 3;
+    clusters.weights = lod.weights.data() + begin;
+    clusters.nbEvents = lod.intervals[last] - begin;
+    return clusters;
+}
+
+void EventLevelsOfDetail::publish(const Frame& frame)
+{
+    std::lock_guard<std::mutex> lock(_publishedFrameMutex);
+    _publishedFrame = frame;
+}
+
+EventLevelsOfDetail::Frame EventLevelsOfDetail::getPublishedFrame()
+{
+    std::lock_guard<std::mutex> lock(_publishedFrameMutex);
+    return _publishedFrame;
+}
+} // namespace brayns
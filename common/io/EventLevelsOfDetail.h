@@ -0,0 +1,100 @@
+/* Copyright (c) 2015-2018, EPFL/Blue Brain Project
+ * All rights reserved. Do not distribute without permission.
+ * Responsible Author: Cyrille Favreau <cyrille.favreau@epfl.ch>
+ *
+ * This file is part of Brayns <https://github.com/BlueBrain/Brayns>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace brayns
+{
+/**
+    Spatial levels of detail of a recording of events, built once when the
+    recording is loaded. Level 0 is the events themselves, and each coarser
+    level clusters the events of the previous one into cells twice as large.
+    Clusters are located at the centroid of their events and weighted by
+    their number of events, which preserves the far field. Events are
+    clustered per interval of the recording, and the clusters of consecutive
+    intervals are contiguous, so that a frame made of consecutive intervals
+    is a single range of clusters
+*/
+class EventLevelsOfDetail
+{
+public:
+    /** Clusters of one coarse level for a range of intervals */
+    struct Clusters
+    {
+        const float* events{nullptr};
+        const float* weights{nullptr};
+        size_t nbEvents{0};
+    };
+
+    /**
+       Frame of a recording last given to the renderers, identified by its
+       number of events
+    */
+    struct Frame
+    {
+        std::shared_ptr<const EventLevelsOfDetail> levels;
+        size_t firstInterval{0};
+        size_t lastInterval{0};
+        uint64_t nbEvents{0};
+    };
+
+    /**
+       Builds the levels of the given events
+       @param events x, y, z triplets of the recording
+       @param nbEvents Number of events
+       @param intervals Index of the first event of each interval, followed
+              by the number of events
+    */
+    EventLevelsOfDetail(const float* events, const size_t nbEvents,
+                        const std::vector<uint64_t>& intervals);
+
+    /** Number of coarse levels, level 0 not included */
+    size_t getNbLevels() const { return _levels.size(); }
+
+    /**
+       Clusters of the given coarse level, starting from 1, for the intervals
+       [firstInterval, lastInterval)
+    */
+    Clusters getClusters(const size_t level, const size_t firstInterval,
+                         const size_t lastInterval) const;
+
+    /**
+       Publishes the frame given to the renderers by a simulation handler.
+       Renderers pick it up on commit
+    */
+    static void publish(const Frame& frame);
+    static Frame getPublishedFrame();
+
+private:
+    struct Level
+    {
+        std::vector<float> events;
+        std::vector<float> weights;
+        std::vector<uint64_t> intervals;
+    };
+
+    std::vector<Level> _levels;
+};
+} // namespace brayns
@@ -0,0 +1,82 @@
+/* Copyright (c) 2015-2018, EPFL/Blue Brain Project
+ * All rights reserved. Do not distribute without permission.
+ * Responsible Author: Cyrille Favreau <cyrille.favreau@epfl.ch>
+ *
+ * This file is part of Brayns <https://github.com/BlueBrain/Brayns>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "SimulationStore.h"
+
+using namespace ospray;
+
+namespace brayns
+{
+SimulationStore::SimulationStore()
+    : _worker(&SimulationStore::_copy, this)
+{
+}
+
+SimulationStore::~SimulationStore()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopped = true;
+    }
+    _condition.notify_one();
+    _worker.join();
+}
+
+void SimulationStore::load(const Ref<Data>& frame)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _requested = frame;
+    }
+    _condition.notify_one();
+}
+
+void SimulationStore::_copy()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true)
+    {
+        _condition.wait(lock, [this] { return _stopped || _requested.ptr; });
+        if (_stopped)
+            return;
+
+        Ref<Data> frame = _requested;
+        _requested = nullptr;
+        lock.unlock();
+        const float* values = static_cast<const float*>(frame->data);
+        _buffers[_back].assign(values, values + frame->size());
+        frame = nullptr;
+        lock.lock();
+
+        std::swap(_back, _ready);
+        _pending = true;
+    }
+}
+
+bool SimulationStore::swap()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_pending)
+        return false;
+    std::swap(_front, _ready);
+    _pending = false;
+    return true;
+}
+} // namespace brayns
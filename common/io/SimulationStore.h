@@ -0,0 +1,84 @@
+/* Copyright (c) 2015-2018, EPFL/Blue Brain Project
+ * All rights reserved. Do not distribute without permission.
+ * Responsible Author: Cyrille Favreau <cyrille.favreau@epfl.ch>
+ *
+ * This file is part of Brayns <https://github.com/BlueBrain/Brayns>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include <ospray/SDK/common/Data.h>
+
+#include <array>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace brayns
+{
+/**
+    Triple-buffered copy of the simulation frames given to a renderer. Frames
+    are copied by a worker thread into the back buffer, which is exchanged
+    with the ready buffer once complete, and the ready buffer becomes the
+    front buffer between two rendered frames. The front buffer is never
+    written while it is rendered, and the render thread never waits for a
+    copy. Frames must not be rewritten by the application while their data
+    is referenced by the store
+*/
+class SimulationStore
+{
+public:
+    SimulationStore();
+    ~SimulationStore();
+
+    /**
+       Queues the copy of the given frame of float values. A frame whose copy
+       has not started yet is replaced
+    */
+    void load(const ospray::Ref<ospray::Data>& frame);
+
+    /**
+       Makes the last copied frame the front buffer. Must not be called
+       while a frame is being rendered
+       @return True if the front buffer changed
+    */
+    bool swap();
+
+    const float* getFrontBuffer() const { return _buffers[_front].data(); }
+    size_t getFrontSize() const { return _buffers[_front].size(); }
+
+private:
+    void _copy();
+
+    std::array<std::vector<float>, 3> _buffers;
+
+    // Only accessed by the rendering thread
+    size_t _front{0};
+
+    // Only accessed by the worker thread
+    size_t _back{1};
+
+    // Shared with the worker thread
+    std::mutex _mutex;
+    std::condition_variable _condition;
+    ospray::Ref<ospray::Data> _requested;
+    size_t _ready{2};
+    bool _pending{false};
+    bool _stopped{false};
+    std::thread _worker;
+};
+} // namespace brayns
@@ -21,13 +21,32 @@
 #include "SimulationRenderer.h"
 #include <brayns/common/log.h>
 
+// ospray
+#include <ospray/SDK/fb/FrameBuffer.h>
+
+// ispc exports
+#include "SimulationRenderer_ispc.h"
+
 namespace brayns
 {
 void SimulationRenderer::commit()
 {
     AbstractRenderer::commit();
 
-    _simulationData = getParamData("simulationData");
+    // Frames are copied by the worker thread of the store, and the same data
+    // is copied again when the timestamp changes, since its buffer may hold
+    // a new frame
+    ospray::Ref<ospray::Data> simulationData = getParamData("simulationData");
+    if (simulationData && (simulationData.ptr != _simulationData.ptr ||
+                           _timestamp != _simulationTimestamp))
+    {
+        if (!_simulationStore)
+            _simulationStore.reset(new SimulationStore());
+        _simulationStore->load(simulationData);
+    }
+    _simulationData = simulationData;
+    _simulationTimestamp = _timestamp;
+
     _transferFunctionDiffuseData = getParamData("transferFunctionDiffuseData");
     _transferFunctionEmissionData =
         getParamData("transferFunctionEmissionData");
@@ -49,7 +68,29 @@ void SimulationRenderer::commit()
     _transferFunctionSize =
         std::min(transferFunctionDiffuseSize, transferFunctionEmissionSize);
 
-    _simulationDataSize = _simulationData ? _simulationData->size() : 0;
+    if (!_simulationData)
+    {
+        _simulationStore.reset();
+        _simulationDataSize = 0;
+        ispc::SimulationRenderer_setSimulationData(getIE(), nullptr, 0);
+    }
+}
+
+float SimulationRenderer::renderFrame(ospray::FrameBuffer* fb,
+                                      const ospray::uint32 channelFlags)
+{
+    // The last copied frame is published by the first frame rendered after
+    // its copy completes. Frames accumulated with the previous simulation
+    // frame are discarded
+    if (_simulationStore && _simulationStore->swap())
+    {
+        fb->clear(OSP_FB_ACCUM);
+        _simulationDataSize = _simulationStore->getFrontSize();
+        ispc::SimulationRenderer_setSimulationData(
+            getIE(), const_cast<float*>(_simulationStore->getFrontBuffer()),
+            _simulationDataSize);
+    }
+    return AbstractRenderer::renderFrame(fb, channelFlags);
 }
 
 } // ::brayns
@@ -25,27 +25,38 @@
 #include "AbstractRenderer.h"
 #include "ExtendedOBJMaterial.h"
 
+// Brayns
+#include <common/io/SimulationStore.h>
+
 // ospray
 #include <ospray/SDK/common/Material.h>
 #include <ospray/SDK/render/Renderer.h>
 
 // system
+#include <memory>
 #include <vector>
 
 namespace brayns
 {
 /**
  * The SimulationRenderer class implements a parent renderer for all Brayns
- * renderers that need to render simulation data
+ * renderers that need to render simulation data. Simulation frames are
+ * queued on commit and copied in the background by a SimulationStore, and
+ * the last copied one is given to the ISPC renderer at the start of the
+ * next frame, which restarts the accumulation
  */
 class SimulationRenderer : public AbstractRenderer
 {
 public:
     void commit() override;
+    float renderFrame(ospray::FrameBuffer* fb,
+                      const ospray::uint32 channelFlags) override;
 
 protected:
     ospray::Ref<ospray::Data> _simulationData;
-    ospray::uint64 _simulationDataSize;
+    ospray::uint64 _simulationDataSize{0};
+    float _simulationTimestamp{0.f};
+    std::unique_ptr<SimulationStore> _simulationStore;
     ospray::Ref<ospray::Data> _transferFunctionDiffuseData;
     ospray::Ref<ospray::Data> _transferFunctionEmissionData;
     float _transferFunctionMinValue;
@@ -23,15 +23,383 @@
 
 // ospray
 #include <ospray/SDK/common/Data.h>
+#include <ospray/SDK/fb/FrameBuffer.h>
 #include <ospray/SDK/lights/Light.h>
+#include <ospray/ospcommon/tasking/parallel_for.h>
 
 // ispc exports
 #include "VoxelizerRenderer_ispc.h"
 
+#include <chrono>
+
 using namespace ospray;
 
 namespace brayns
 {
+// Maximum number of cells of the event grid along one axis
+const int MAX_GRID_DIMENSION = 256;
+
+// Octree nodes are split until they hold fewer events, or reach the maximum
+// depth. The depth is bounded by the traversal stack in the ispc code
+const size_t OCTREE_LEAF_SIZE = 16;
+const size_t OCTREE_MAX_DEPTH = 20;
+
+void VoxelizerRenderer::_setLevelsOfDetail()
+{
+    // Levels only apply to the frame of events they were published with
+    _lodFrame = EventLevelsOfDetail::getPublishedFrame();
+    _lodClusters.clear();
+    if (!_lodFrame.levels || _lodFrame.nbEvents * 3 != _nbEvents)
+        return;
+
+    for (size_t level = 1; level <= _lodFrame.levels->getNbLevels(); ++level)
+        _lodClusters.push_back(_lodFrame.levels->getClusters(
+            level, _lodFrame.firstInterval, _lodFrame.lastInterval));
+}
+
+void VoxelizerRenderer::_setLevelOfDetail(const int32 level)
+{
+    _currentLodLevel =
+        std::max(0, std::min(level, int32(_lodClusters.size())));
+    if (_currentLodLevel == 0)
+    {
+        _activeEvents = _events ? (const float*)_events->data : nullptr;
+        _activeWeights = nullptr;
+        _nbActiveEvents = _nbEvents;
+    }
+    else
+    {
+        const auto& clusters = _lodClusters[_currentLodLevel - 1];
+        _activeEvents = clusters.events;
+        _activeWeights = clusters.weights;
+        _nbActiveEvents = clusters.nbEvents * 3;
+    }
+
+    ispc::VoxelizerRenderer_setEvents(getIE(), (float*)_activeEvents,
+                                      (float*)_activeWeights, _nbActiveEvents);
+
+    // Spatial index, only rebuilt when events, level of detail or influence
+    // radius change
+    if (_events.ptr != _gridEventsData.ptr ||
+        _currentLodLevel != _gridLodLevel ||
+        _influenceRadius != _gridInfluenceRadius)
+        _buildEventGrid();
+
+    ispc::VoxelizerRenderer_setEventGrid(
+        getIE(), _gridCells.empty() ? nullptr : _gridCells.data(),
+        _gridEvents.empty() ? nullptr : _gridEvents.data(),
+        _gridWeights.empty() ? nullptr : _gridWeights.data(),
+        (ispc::vec3f&)_gridOrigin, (ispc::vec3i&)_gridDimensions,
+        _gridCellSize, _gridInfluenceRadius);
+
+    // Octree, only rebuilt when events or level of detail change
+    if (_openingAngle > 0.f && (_events.ptr != _octreeEventsData.ptr ||
+                                _currentLodLevel != _octreeLodLevel))
+        _buildOctree();
+
+    const bool useOctree = _openingAngle > 0.f && !_octreeNodes.empty();
+    ispc::VoxelizerRenderer_setOctree(
+        getIE(), useOctree ? _octreeNodes.data() : nullptr,
+        useOctree ? _octreeEvents.data() : nullptr,
+        useOctree && !_octreeWeights.empty() ? _octreeWeights.data() : nullptr,
+        _openingAngle);
+}
+
+void VoxelizerRenderer::_swapLevelStructures(const int32 level)
+{
+    LevelStructures& structures = _levelStructures[level];
+    std::swap(_gridEventsData, structures.gridEventsData);
+    std::swap(_gridLodLevel, structures.gridLodLevel);
+    std::swap(_gridInfluenceRadius, structures.gridInfluenceRadius);
+    std::swap(_gridOrigin, structures.gridOrigin);
+    std::swap(_gridDimensions, structures.gridDimensions);
+    std::swap(_gridCellSize, structures.gridCellSize);
+    _gridCells.swap(structures.gridCells);
+    _gridEvents.swap(structures.gridEvents);
+    _gridWeights.swap(structures.gridWeights);
+    std::swap(_octreeEventsData, structures.octreeEventsData);
+    std::swap(_octreeLodLevel, structures.octreeLodLevel);
+    _octreeNodes.swap(structures.octreeNodes);
+    _octreeEvents.swap(structures.octreeEvents);
+    _octreeWeights.swap(structures.octreeWeights);
+    std::swap(_shadowEventsData, structures.shadowEventsData);
+    _shadowKey.swap(structures.shadowKey);
+    std::swap(_shadowDataResolution, structures.shadowDataResolution);
+    _shadowVolume.swap(structures.shadowVolume);
+}
+
+void VoxelizerRenderer::_prepareLevelsOfDetail()
+{
+    // Structures of the other levels are swapped in, brought up to date,
+    // and swapped out again. Only outdated structures are rebuilt
+    const int32 current = _currentLodLevel;
+    _levelStructures.resize(_lodClusters.size() + 1);
+    for (int32 level = 0; level < int32(_levelStructures.size()); ++level)
+    {
+        if (level == current)
+            continue;
+        _swapLevelStructures(level);
+        _setLevelOfDetail(level);
+        _updateShadowVolume();
+        _swapLevelStructures(level);
+    }
+    _setLevelOfDetail(current);
+    _updateShadowVolume();
+}
+
+void VoxelizerRenderer::_buildEventGrid()
+{
+    _gridEventsData = _events;
+    _gridLodLevel = _currentLodLevel;
+    _gridInfluenceRadius = _influenceRadius;
+    _gridCells.clear();
+    _gridEvents.clear();
+    _gridWeights.clear();
+
+    const size_t nbEvents = _nbActiveEvents / 3;
+    if (nbEvents == 0 || _influenceRadius <= 0.f)
+        return;
+
+    const float* events = _activeEvents;
+    const float* weights = _activeWeights;
+    box3f bounds = empty;
+    for (size_t i = 0; i < nbEvents; ++i)
+        bounds.extend(
+            vec3f(events[i * 3], events[i * 3 + 1], events[i * 3 + 2]));
+
+    // Cells are at least as large as the influence radius so that a field
+    // evaluation never visits more than 3x3x3 cells
+    const vec3f extent = bounds.size();
+    const float maxExtent = std::max(extent.x, std::max(extent.y, extent.z));
+    _gridCellSize =
+        std::max(_influenceRadius, maxExtent / float(MAX_GRID_DIMENSION));
+    _gridOrigin = bounds.lower;
+    _gridDimensions = vec3i(int(extent.x / _gridCellSize) + 1,
+                            int(extent.y / _gridCellSize) + 1,
+                            int(extent.z / _gridCellSize) + 1);
+
+    const size_t nbCells = size_t(_gridDimensions.x) * _gridDimensions.y *
+                           _gridDimensions.z;
+    std::vector<uint32> eventCells(nbEvents);
+    _gridCells.resize(nbCells + 1, 0);
+    for (size_t i = 0; i < nbEvents; ++i)
+    {
+        const vec3f p(events[i * 3], events[i * 3 + 1], events[i * 3 + 2]);
+        const vec3i cell = min(vec3i((p - _gridOrigin) / _gridCellSize),
+                               _gridDimensions - vec3i(1));
+        eventCells[i] =
+            cell.x + _gridDimensions.x * (cell.y + _gridDimensions.y * cell.z);
+        ++_gridCells[eventCells[i] + 1];
+    }
+
+    // Counting sort of events per cell
+    for (size_t i = 0; i < nbCells; ++i)
+        _gridCells[i + 1] += _gridCells[i];
+
+    std::vector<uint32> offsets(_gridCells.begin(), _gridCells.end() - 1);
+    _gridEvents.resize(nbEvents * 3);
+    if (weights)
+        _gridWeights.resize(nbEvents);
+    for (size_t i = 0; i < nbEvents; ++i)
+    {
+        const size_t index = offsets[eventCells[i]]++;
+        _gridEvents[index * 3] = events[i * 3];
+        _gridEvents[index * 3 + 1] = events[i * 3 + 1];
+        _gridEvents[index * 3 + 2] = events[i * 3 + 2];
+        if (weights)
+            _gridWeights[index] = weights[i];
+    }
+}
+
+void VoxelizerRenderer::_buildOctree()
+{
+    _octreeEventsData = _events;
+    _octreeLodLevel = _currentLodLevel;
+    _octreeNodes.clear();
+    _octreeEvents.clear();
+    _octreeWeights.clear();
+
+    const size_t nbEvents = _nbActiveEvents / 3;
+    if (nbEvents == 0)
+        return;
+
+    const float* events = _activeEvents;
+    box3f bounds = empty;
+    for (size_t i = 0; i < nbEvents; ++i)
+        bounds.extend(
+            vec3f(events[i * 3], events[i * 3 + 1], events[i * 3 + 2]));
+    const vec3f extent = bounds.size();
+    const float size = std::max(extent.x, std::max(extent.y, extent.z));
+
+    // Event indices are partitioned in place so that the events of any node
+    // are contiguous
+    std::vector<uint32> indices(nbEvents);
+    for (size_t i = 0; i < nbEvents; ++i)
+        indices[i] = i;
+    _octreeNodes.resize(1);
+    _buildOctreeNode(0, indices.data(), 0, nbEvents, bounds.lower, size, 0);
+
+    _octreeEvents.resize(nbEvents * 3);
+    for (size_t i = 0; i < nbEvents; ++i)
+        for (size_t j = 0; j < 3; ++j)
+            _octreeEvents[i * 3 + j] = events[indices[i] * 3 + j];
+    if (_activeWeights)
+    {
+        _octreeWeights.resize(nbEvents);
+        for (size_t i = 0; i < nbEvents; ++i)
+            _octreeWeights[i] = _activeWeights[indices[i]];
+    }
+}
+
+void VoxelizerRenderer::_buildOctreeNode(const size_t nodeIndex,
+                                         uint32* indices, const size_t begin,
+                                         const size_t end, const vec3f& lower,
+                                         const float size, const size_t depth)
+{
+    const float* events = _activeEvents;
+    const auto position = [events](const uint32 index) {
+        return vec3f(events[index * 3], events[index * 3 + 1],
+                     events[index * 3 + 2]);
+    };
+
+    OctreeNode node;
+    node.center = vec3f(0.f);
+    node.weight = 0.f;
+    node.size = size;
+    for (size_t i = begin; i < end; ++i)
+    {
+        const float weight = _activeWeights ? _activeWeights[indices[i]] : 1.f;
+        node.center = node.center + position(indices[i]) * weight;
+        node.weight += weight;
+    }
+    node.center = node.center / node.weight;
+
+    if (end - begin <= OCTREE_LEAF_SIZE || depth == OCTREE_MAX_DEPTH)
+    {
+        node.first = begin;
+        node.count = end - begin;
+        node.leaf = 1;
+        _octreeNodes[nodeIndex] = node;
+        return;
+    }
+
+    // Split events into octants, along z, then y, then x
+    const vec3f middle = lower + vec3f(size * 0.5f);
+    size_t bounds[9];
+    bounds[0] = begin;
+    bounds[8] = end;
+    const auto split = [&](const size_t first, const size_t last,
+                           const size_t axis) {
+        return std::partition(indices + bounds[first], indices + bounds[last],
+                              [&](const uint32 index) {
+                                  return position(index)[axis] < middle[axis];
+                              }) -
+               indices;
+    };
+    bounds[4] = split(0, 8, 2);
+    bounds[2] = split(0, 4, 1);
+    bounds[6] = split(4, 8, 1);
+    for (size_t i = 0; i < 8; i += 2)
+        bounds[i + 1] = split(i, i + 2, 0);
+
+    // Non-empty children are stored contiguously
+    node.first = _octreeNodes.size();
+    node.count = 0;
+    node.leaf = 0;
+    for (size_t i = 0; i < 8; ++i)
+        if (bounds[i + 1] > bounds[i])
+            ++node.count;
+    _octreeNodes[nodeIndex] = node;
+    _octreeNodes.resize(_octreeNodes.size() + node.count);
+
+    size_t child = node.first;
+    for (size_t i = 0; i < 8; ++i)
+        if (bounds[i + 1] > bounds[i])
+        {
+            const vec3f childLower(i & 1 ? middle.x : lower.x,
+                                   i & 2 ? middle.y : lower.y,
+                                   i & 4 ? middle.z : lower.z);
+            _buildOctreeNode(child++, indices, bounds[i], bounds[i + 1],
+                             childLower, size * 0.5f, depth + 1);
+        }
+}
+
+void VoxelizerRenderer::_bakeField()
+{
+    _fieldEventsData = _events;
+    _fieldDivider = _divider;
+    _fieldInfluenceRadius = _influenceRadius;
+    _fieldLodLevel = _currentLodLevel;
+    _fieldOpeningAngle = _openingAngle;
+    _fieldDataResolution = 0;
+    _field.clear();
+
+    // The field is evaluated from the events while baking
+    ispc::VoxelizerRenderer_setField(getIE(), nullptr, 0);
+
+    if (_nbEvents == 0 || _fieldResolution <= 0)
+        return;
+
+    const int32 resolution = _fieldResolution;
+    _field.resize(size_t(resolution) * resolution * resolution);
+    tasking::parallel_for(resolution, [&](int z) {
+        ispc::VoxelizerRenderer_bakeField(getIE(), _field.data(), resolution,
+                                          z);
+    });
+    _fieldDataResolution = resolution;
+}
+
+void VoxelizerRenderer::_bakeShadowVolume()
+{
+    _shadowDataResolution = 0;
+    _shadowVolume.clear();
+
+    // Shadows are evaluated from the field while baking
+    ispc::VoxelizerRenderer_setShadowVolume(getIE(), nullptr, 0);
+
+    if (_nbEvents == 0 || _shadowResolution <= 0 || _lightArray.empty())
+        return;
+
+    const int32 resolution = _shadowResolution;
+    _shadowVolume.resize(size_t(resolution) * resolution * resolution);
+    tasking::parallel_for(resolution, [&](int z) {
+        ispc::VoxelizerRenderer_bakeShadowVolume(getIE(), _shadowVolume.data(),
+                                                 resolution, z);
+    });
+    _shadowDataResolution = resolution;
+}
+
+void VoxelizerRenderer::_updateShadowVolume()
+{
+    // Shadow volume. Lights are identified by their directions as seen from
+    // the corners of the volume, which also captures positional lights
+    std::vector<float> shadowKey{_divider,
+                                 _influenceRadius,
+                                 float(_currentLodLevel),
+                                 _openingAngle,
+                                 float(_fieldDataResolution),
+                                 float(_samplesPerShadowRay),
+                                 _pixelOpacity > 0.f ? 1.f : 0.f};
+    shadowKey.resize(shadowKey.size() + _lightArray.size() * 8 * 3);
+    ispc::VoxelizerRenderer_getLightDirections(
+        getIE(), shadowKey.data() + shadowKey.size() - _lightArray.size() * 24);
+
+    const bool useShadowVolume = _shadows > 0.f && _softShadows == 0.f;
+    const int32 shadowResolution = useShadowVolume ? _shadowResolution : 0;
+    if (_events.ptr != _shadowEventsData.ptr || shadowKey != _shadowKey ||
+        shadowResolution != _shadowDataResolution)
+    {
+        _shadowEventsData = _events;
+        _shadowKey = shadowKey;
+        _shadowResolution = shadowResolution;
+        _bakeShadowVolume();
+    }
+
+    ispc::VoxelizerRenderer_setShadowVolume(
+        getIE(), _shadowVolume.empty() ? nullptr : _shadowVolume.data(),
+        _shadowDataResolution);
+}
+
 void VoxelizerRenderer::commit()
 {
     Renderer::commit();
@@ -76,13 +444,76 @@ void VoxelizerRenderer::commit()
     // Events
     _events = getParamData("simulationData");
     _nbEvents = _events ? _events->size() : 0;
+    _influenceRadius = getParam1f("influenceRadius", 0.f);
+    _openingAngle = getParam1f("openingAngle", 0.f);
 
     ispc::VoxelizerRenderer_set(
-        getIE(), (_events ? (float*)_events->data : nullptr), _nbEvents,
-        (ispc::vec3f&)_bgColor, _shadows, _softShadows, _shadingEnabled,
+        getIE(), (ispc::vec3f&)_bgColor, _shadows, _softShadows, _shadingEnabled,
         _randomNumber, _timestamp, _spp, _softnessEnabled, _lightPtr,
         _lightArray.size(), _materialPtr, _materialArray.size(), _samplesPerRay,
         _samplesPerShadowRay, _exposure, _divider, _pixelOpacity);
+
+    // Levels of detail. A negative level lets the renderer pick the finest
+    // level that fits in the frame time budget
+    _lodLevel = getParam1i("lodLevel", 0);
+    _frameTimeBudget = getParam1f("frameTimeBudget", 0.f);
+    _setLevelsOfDetail();
+    _setLevelOfDetail(_lodLevel >= 0 ? _lodLevel : _currentLodLevel);
+
+    // Baked field
+    _fieldResolution = getParam1i("fieldResolution", 0);
+    if (_events.ptr != _fieldEventsData.ptr || _divider != _fieldDivider ||
+        _influenceRadius != _fieldInfluenceRadius ||
+        _currentLodLevel != _fieldLodLevel ||
+        _openingAngle != _fieldOpeningAngle ||
+        _fieldResolution != _fieldDataResolution)
+        _bakeField();
+
+    ispc::VoxelizerRenderer_setField(getIE(),
+                                     _field.empty() ? nullptr : _field.data(),
+                                     _fieldDataResolution);
+
+    _shadowResolution = getParam1i("shadowResolution", 0);
+    _updateShadowVolume();
+
+    // Automatic levels of detail, which do not apply to a baked field
+    if (_lodLevel < 0 && _frameTimeBudget > 0.f && _field.empty())
+        _prepareLevelsOfDetail();
+    else
+        _levelStructures.clear();
+}
+
+float VoxelizerRenderer::renderFrame(FrameBuffer* fb,
+                                     const uint32 channelFlags)
+{
+    const auto start = std::chrono::high_resolution_clock::now();
+    const float result = Renderer::renderFrame(fb, channelFlags);
+    if (_lodLevel >= 0 || _frameTimeBudget <= 0.f || !_field.empty())
+        return result;
+
+    // Coarsen the events when the frame exceeds the budget, and refine them
+    // when there is enough headroom for the next finer level. The
+    // structures of every level were prepared on commit, and frames
+    // accumulated with the previous level are discarded
+    const float elapsed =
+        std::chrono::duration<float, std::milli>(
+            std::chrono::high_resolution_clock::now() - start)
+            .count();
+    int32 level = _currentLodLevel;
+    if (elapsed > _frameTimeBudget &&
+        _currentLodLevel < int32(_lodClusters.size()))
+        ++level;
+    else if (elapsed < 0.25f * _frameTimeBudget && _currentLodLevel > 0)
+        --level;
+    if (level == _currentLodLevel || level >= int32(_levelStructures.size()))
+        return result;
+
+    _swapLevelStructures(_currentLodLevel);
+    _swapLevelStructures(level);
+    _setLevelOfDetail(level);
+    _updateShadowVolume();
+    fb->clear(OSP_FB_ACCUM);
+    return result;
 }
 
 VoxelizerRenderer::VoxelizerRenderer()
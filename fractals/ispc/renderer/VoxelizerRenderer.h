@@ -21,6 +21,7 @@
 
 #pragma once
 
+#include <common/io/EventLevelsOfDetail.h>
 #include <common/ispc/renderer/AbstractRenderer.h>
 
 namespace brayns
@@ -36,8 +37,24 @@ public:
     */
     std::string toString() const final { return "VoxelizerRenderer"; }
     void commit() final;
+    float renderFrame(ospray::FrameBuffer* fb,
+                      const ospray::uint32 channelFlags) final;
 
 private:
+    void _setLevelsOfDetail();
+    void _setLevelOfDetail(const ospray::int32 level);
+    void _prepareLevelsOfDetail();
+    void _swapLevelStructures(const ospray::int32 level);
+    void _buildEventGrid();
+    void _buildOctree();
+    void _buildOctreeNode(const size_t nodeIndex, ospray::uint32* indices,
+                          const size_t begin, const size_t end,
+                          const ospray::vec3f& lower, const float size,
+                          const size_t depth);
+    void _bakeField();
+    void _bakeShadowVolume();
+    void _updateShadowVolume();
+
     std::vector<void*> _lightArray;
     void** _lightPtr;
     std::vector<void*> _materialArray;
@@ -68,5 +85,99 @@ private:
     // Events
     ospray::Ref<ospray::Data> _events;
     ospray::uint64 _nbEvents;
+
+    // Levels of detail, built at load time by the simulation handler and
+    // published with the frame of events, which _lodFrame keeps alive.
+    // _lodClusters holds the clusters of the current frame for each coarse
+    // level
+    EventLevelsOfDetail::Frame _lodFrame;
+    std::vector<EventLevelsOfDetail::Clusters> _lodClusters;
+    ospray::int32 _lodLevel;
+    float _frameTimeBudget;
+    ospray::int32 _currentLodLevel{0};
+    const float* _activeEvents{nullptr};
+    const float* _activeWeights{nullptr};
+    ospray::uint64 _nbActiveEvents{0};
+
+    // Spatial index over events of the current level of detail. Events are
+    // sorted by grid cell and _gridCells holds, for each cell, the offset of
+    // its first event
+    float _influenceRadius;
+    ospray::Ref<ospray::Data> _gridEventsData;
+    ospray::int32 _gridLodLevel{0};
+    float _gridInfluenceRadius{0.f};
+    ospray::vec3f _gridOrigin;
+    ospray::vec3i _gridDimensions;
+    float _gridCellSize{0.f};
+    std::vector<ospray::uint32> _gridCells;
+    std::vector<float> _gridEvents;
+    std::vector<float> _gridWeights;
+
+    // Barnes-Hut octree over events of the current level of detail. Nodes
+    // hold the centroid and total weight of their events and are used as a
+    // single event when seen under an angle smaller than the opening angle.
+    // This layout must match VoxelizerOctreeNode in VoxelizerRenderer.ispc
+    struct OctreeNode
+    {
+        ospray::vec3f center;
+        float weight;
+        float size;
+        ospray::uint32 first; // First child node, or first event of a leaf
+        ospray::uint32 count; // Number of child nodes, or events of a leaf
+        ospray::uint32 leaf;
+    };
+    float _openingAngle;
+    ospray::Ref<ospray::Data> _octreeEventsData;
+    ospray::int32 _octreeLodLevel{0};
+    std::vector<OctreeNode> _octreeNodes;
+    std::vector<float> _octreeEvents;
+    std::vector<float> _octreeWeights;
+
+    // Field baked into a regular grid, only rebuilt when events, divider or
+    // resolution change
+    ospray::int32 _fieldResolution;
+    ospray::Ref<ospray::Data> _fieldEventsData;
+    float _fieldDivider{0.f};
+    float _fieldInfluenceRadius{0.f};
+    ospray::int32 _fieldLodLevel{0};
+    float _fieldOpeningAngle{0.f};
+    ospray::int32 _fieldDataResolution{0};
+    std::vector<float> _field;
+
+    // Shadow contribution of all lights baked into a regular grid. It is
+    // only rebuilt when lights or any input of the field change, and is not
+    // used with soft shadows since their directions are randomized
+    ospray::int32 _shadowResolution;
+    ospray::Ref<ospray::Data> _shadowEventsData;
+    std::vector<float> _shadowKey;
+    ospray::int32 _shadowDataResolution{0};
+    std::vector<float> _shadowVolume;
+
+    // Spatial index, octree and shadow volume of the levels of detail other
+    // than the current one. With automatic levels, they are prepared on
+    // commit, and switching levels between frames only swaps them with the
+    // structures of the current level
+    struct LevelStructures
+    {
+        ospray::Ref<ospray::Data> gridEventsData;
+        ospray::int32 gridLodLevel{0};
+        float gridInfluenceRadius{0.f};
+        ospray::vec3f gridOrigin;
+        ospray::vec3i gridDimensions;
+        float gridCellSize{0.f};
+        std::vector<ospray::uint32> gridCells;
+        std::vector<float> gridEvents;
+        std::vector<float> gridWeights;
+        ospray::Ref<ospray::Data> octreeEventsData;
+        ospray::int32 octreeLodLevel{0};
+        std::vector<OctreeNode> octreeNodes;
+        std::vector<float> octreeEvents;
+        std::vector<float> octreeWeights;
+        ospray::Ref<ospray::Data> shadowEventsData;
+        std::vector<float> shadowKey;
+        ospray::int32 shadowDataResolution{0};
+        std::vector<float> shadowVolume;
+    };
+    std::vector<LevelStructures> _levelStructures;
 };
 } // namespace brayns
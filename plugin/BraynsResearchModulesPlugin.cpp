@@ -22,8 +22,6 @@
 #include "BraynsResearchModulesPlugin.h"
 #include "log.h"
 
-#include <plugin/io/EEGHandler.h>
-
 #include <brayns/common/ActionInterface.h>
 #include <brayns/engineapi/Engine.h>
 #include <brayns/engineapi/Model.h>
@@ -86,6 +84,18 @@ void _addVoxelizerRenderer(brayns::Engine& engine)
         {"samplesPerShadowRay", 4, 4, 1024, {"Samples per shadow ray"}});
     properties.setProperty({"pixelOpacity", 1.0, 0.01, 1.0, {"Pixel opacity"}});
     properties.setProperty({"divider", 20000.0, 1.0, 50000.0, {"Divider"}});
+    properties.setProperty({"openingAngle", 0.0, 0.0, 2.0,
+                            {"Field approximation (Barnes-Hut opening angle)"}});
+    properties.setProperty(
+        {"influenceRadius", 0.0, 0.0, 1.0, {"Event influence radius"}});
+    properties.setProperty(
+        {"fieldResolution", 0, 0, 512, {"Baked field resolution"}});
+    properties.setProperty(
+        {"shadowResolution", 0, 0, 512, {"Baked shadow resolution"}});
+    properties.setProperty(
+        {"lodLevel", 0, -1, 7, {"Level of detail (-1 for automatic)"}});
+    properties.setProperty(
+        {"frameTimeBudget", 0.0, 0.0, 1000.0, {"Frame time budget (ms)"}});
     engine.addRendererType("research_voxelizer", properties);
 }
 
@@ -142,6 +152,20 @@ BraynsResearchModulesPlugin::BraynsResearchModulesPlugin()
 {
 }
 
+BraynsResearchModulesPlugin::~BraynsResearchModulesPlugin()
+{
+    // Threads are joined without holding the lock of the jobs
+    std::map<uint32_t, EEGLoadingJobPtr> jobs;
+    {
+        std::lock_guard<std::mutex> lock(_eegJobsMutex);
+        jobs.swap(_eegJobs);
+    }
+    for (auto& job : jobs)
+        job.second->cancelled = true;
+    for (auto& job : jobs)
+        job.second->thread.join();
+}
+
 void BraynsResearchModulesPlugin::init()
 {
     auto& engine = _api->getEngine();
@@ -159,32 +183,244 @@ void BraynsResearchModulesPlugin::init()
     auto actionInterface = _api->getActionInterface();
     if (actionInterface)
     {
-        PLUGIN_INFO << "Registering 'attach-cell-growth-handler' endpoint"
+        PLUGIN_INFO << "Registering 'attach-eeg-file' endpoint" << std::endl;
+        _api->getActionInterface()
+            ->registerRequest<AttachEEGFile, EEGFileJob>(
+                "attach-eeg-file",
+                [&](const AttachEEGFile& s) { return _attachEEGFile(s); });
+
+        PLUGIN_INFO << "Registering 'cancel-eeg-file-job' endpoint"
                     << std::endl;
-        _api->getActionInterface()->registerNotification<AttachEEGFile>(
-            "attach-eeg-file",
-            [&](const AttachEEGFile& s) { _attachEEGFile(s); });
+        _api->getActionInterface()->registerNotification<CancelEEGFileJob>(
+            "cancel-eeg-file-job",
+            [&](const CancelEEGFileJob& s) { _cancelEEGFileJob(s); });
+
+        PLUGIN_INFO << "Registering 'convert-eeg-file' endpoint" << std::endl;
+        _api->getActionInterface()
+            ->registerRequest<ConvertEEGFile, EEGFileJob>(
+                "convert-eeg-file", [&](const ConvertEEGFile& s) {
+                    return _startEEGFileConversion(s);
+                });
+    }
+}
+
+EEGFileJob BraynsResearchModulesPlugin::_attachEEGFile(
+    const AttachEEGFile& payload)
+{
+    EEGFileJob result;
+    if (!_api->getScene().getModel(payload.modelId))
+    {
+        result.error =
+            "Model " + std::to_string(payload.modelId) + " is not registered";
+        PLUGIN_INFO << result.error << std::endl;
+        return result;
     }
+
+    std::lock_guard<std::mutex> lock(_eegJobsMutex);
+    auto job = std::make_shared<EEGLoadingJob>();
+    job->id = _nextEEGJobId++;
+    job->payload = payload;
+    job->thread = std::thread([this, job]() { _loadEEGFile(*job); });
+    _eegJobs[job->id] = job;
+
+    result.success = true;
+    result.jobId = job->id;
+    return result;
+}
+
+void BraynsResearchModulesPlugin::_loadEEGFile(EEGLoadingJob& job)
+{
+    const auto& payload = job.payload;
+    try
+    {
+        auto handler = std::make_shared<EEGHandler>(
+            payload.path, payload.scale, payload.density, payload.dt,
+            payload.timeWindow,
+            [&job, this](const std::string& message, const float progress) {
+                if (job.cancelled)
+                    throw std::runtime_error("Loading of " + job.payload.path +
+                                             " was cancelled");
+                {
+                    std::lock_guard<std::mutex> lock(job.mutex);
+                    job.message = message;
+                    job.progress = progress;
+                }
+                _api->getEngine().triggerRender();
+            });
+        std::lock_guard<std::mutex> lock(job.mutex);
+        job.handler = handler;
+        job.message = "Loaded";
+        job.progress = 1.f;
+    }
+    catch (const std::exception& e)
+    {
+        // Exceptions must not escape the thread, which would terminate the
+        // application
+        PLUGIN_INFO << e.what() << std::endl;
+        std::lock_guard<std::mutex> lock(job.mutex);
+        job.message = e.what();
+    }
+    catch (...)
+    {
+        PLUGIN_INFO << "Failed to load " << payload.path << std::endl;
+        std::lock_guard<std::mutex> lock(job.mutex);
+        job.message = "Failed to load " + payload.path;
+    }
+    job.done = true;
+
+    // Cancelled jobs include the ones of a plugin being destroyed
+    if (!job.cancelled)
+        _api->getEngine().triggerRender();
+}
+
+void BraynsResearchModulesPlugin::_cancelEEGFileJob(
+    const CancelEEGFileJob& payload)
+{
+    std::lock_guard<std::mutex> lock(_eegJobsMutex);
+    auto it = _eegJobs.find(payload.jobId);
+    if (it != _eegJobs.end())
+        it->second->cancelled = true;
+    else
+        PLUGIN_INFO << "EEG file job " << payload.jobId << " does not exist"
+                    << std::endl;
 }
 
-void BraynsResearchModulesPlugin::_attachEEGFile(const AttachEEGFile& payload)
+void BraynsResearchModulesPlugin::_notifyEEGFileJob(const uint32_t jobId,
+                                                    const std::string& state,
+                                                    const float progress,
+                                                    const std::string& message)
 {
-    auto modelDescriptor = _api->getScene().getModel(payload.modelId);
-    if (modelDescriptor)
-        try
+    auto actionInterface = _api->getActionInterface();
+    if (!actionInterface)
+        return;
+
+    EEGFileJobProgress notification;
+    notification.jobId = jobId;
+    notification.state = state;
+    notification.progress = progress;
+    notification.message = message;
+    actionInterface->notify("eeg-file-job-progress", notification);
+}
+
+void BraynsResearchModulesPlugin::preRender()
+{
+    std::vector<EEGLoadingJobPtr> completedJobs;
+    {
+        std::lock_guard<std::mutex> lock(_eegJobsMutex);
+        for (auto it = _eegJobs.begin(); it != _eegJobs.end();)
         {
-            auto handler =
-                std::make_shared<EEGHandler>(payload.path, payload.scale,
-                                             payload.density);
-            modelDescriptor->getModel().setSimulationHandler(handler);
+            auto& job = *it->second;
+            if (job.done)
+            {
+                completedJobs.push_back(it->second);
+                it = _eegJobs.erase(it);
+                continue;
+            }
+
+            std::lock_guard<std::mutex> jobLock(job.mutex);
+            if (job.progress != job.publishedProgress)
+            {
+                _notifyEEGFileJob(job.id, "running", job.progress,
+                                  job.message);
+                job.publishedProgress = job.progress;
+            }
+            ++it;
         }
-        catch (const std::runtime_error& e)
+    }
+
+    for (auto& job : completedJobs)
+    {
+        job->thread.join();
+
+        // Completed conversions are reported even if they were cancelled
+        if (job->converting && job->converted)
         {
-            PLUGIN_INFO << e.what() << std::endl;
+            _notifyEEGFileJob(job->id, "done", job->progress, job->message);
+            continue;
         }
-    else
-        PLUGIN_INFO << "Model " << payload.modelId << " is not registered"
-                    << std::endl;
+        if (job->cancelled)
+        {
+            _notifyEEGFileJob(job->id, "cancelled", job->progress,
+                              job->message);
+            continue;
+        }
+        if (job->converting || !job->handler)
+        {
+            _notifyEEGFileJob(job->id, "failed", job->progress, job->message);
+            continue;
+        }
+
+        // The model might have been removed while the file was loading
+        auto modelDescriptor = _api->getScene().getModel(job->payload.modelId);
+        if (!modelDescriptor)
+        {
+            _notifyEEGFileJob(job->id, "failed", job->progress,
+                              "Model " +
+                                  std::to_string(job->payload.modelId) +
+                                  " is not registered");
+            continue;
+        }
+        modelDescriptor->getModel().setSimulationHandler(job->handler);
+        _notifyEEGFileJob(job->id, "done", 1.f, job->message);
+    }
+}
+
+EEGFileJob BraynsResearchModulesPlugin::_startEEGFileConversion(
+    const ConvertEEGFile& payload)
+{
+    std::lock_guard<std::mutex> lock(_eegJobsMutex);
+    auto job = std::make_shared<EEGLoadingJob>();
+    job->id = _nextEEGJobId++;
+    job->converting = true;
+    job->conversion = payload;
+    job->thread = std::thread([this, job]() { _convertEEGFile(*job); });
+    _eegJobs[job->id] = job;
+
+    EEGFileJob result;
+    result.success = true;
+    result.jobId = job->id;
+    return result;
+}
+
+void BraynsResearchModulesPlugin::_convertEEGFile(EEGLoadingJob& job)
+{
+    const auto& payload = job.conversion;
+    try
+    {
+        EEGHandler::convert(
+            payload.path, payload.outputPath, payload.scale,
+            [&job, this](const std::string& message, const float progress) {
+                if (job.cancelled)
+                    throw std::runtime_error("Conversion of " +
+                                             job.conversion.path +
+                                             " was cancelled");
+                {
+                    std::lock_guard<std::mutex> lock(job.mutex);
+                    job.message = message;
+                    job.progress = progress;
+                }
+                _api->getEngine().triggerRender();
+            });
+        std::lock_guard<std::mutex> lock(job.mutex);
+        job.converted = true;
+        job.message = "Converted";
+        job.progress = 1.f;
+    }
+    catch (const std::exception& e)
+    {
+        PLUGIN_INFO << e.what() << std::endl;
+        std::lock_guard<std::mutex> lock(job.mutex);
+        job.message = e.what();
+    }
+    catch (...)
+    {
+        PLUGIN_INFO << "Failed to convert " << payload.path << std::endl;
+        std::lock_guard<std::mutex> lock(job.mutex);
+        job.message = "Failed to convert " + payload.path;
+    }
+    job.done = true;
+    if (!job.cancelled)
+        _api->getEngine().triggerRender();
 }
 
 extern "C" brayns::ExtensionPlugin* brayns_plugin_create(int /*argc*/,
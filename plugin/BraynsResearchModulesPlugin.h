@@ -24,6 +24,12 @@
 
 #include <brayns/pluginapi/ExtensionPlugin.h>
 #include <plugin/api/ResearchModulesParams.h>
+#include <plugin/io/EEGHandler.h>
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <thread>
 
 /**
  * @brief The BraynsResearchModulesPlugin class manages the Brayns research
@@ -33,10 +39,49 @@ class BraynsResearchModulesPlugin : public brayns::ExtensionPlugin
 {
 public:
     BraynsResearchModulesPlugin();
+    ~BraynsResearchModulesPlugin();
 
     void init() final;
 
+    /**
+     * @brief Publishes the progress of EEG loading and conversion jobs, and
+     * installs the handlers of completed loading jobs on their model
+     */
+    void preRender() final;
+
 private:
-    void _attachEEGFile(const AttachEEGFile&);
+    /**
+     * @brief Background loading of an EEG file, or conversion of a text EEG
+     * file when converting is set
+     */
+    struct EEGLoadingJob
+    {
+        uint32_t id;
+        AttachEEGFile payload;
+        bool converting{false};
+        ConvertEEGFile conversion;
+        bool converted{false};
+        std::thread thread;
+        std::atomic<bool> cancelled{false};
+        std::atomic<bool> done{false};
+        std::mutex mutex;
+        float progress{0.f};
+        std::string message;
+        float publishedProgress{-1.f};
+        EEGHandlerPtr handler;
+    };
+    typedef std::shared_ptr<EEGLoadingJob> EEGLoadingJobPtr;
+
+    EEGFileJob _attachEEGFile(const AttachEEGFile&);
+    void _loadEEGFile(EEGLoadingJob& job);
+    void _cancelEEGFileJob(const CancelEEGFileJob&);
+    void _notifyEEGFileJob(const uint32_t jobId, const std::string& state,
+                           const float progress, const std::string& message);
+    EEGFileJob _startEEGFileConversion(const ConvertEEGFile&);
+    void _convertEEGFile(EEGLoadingJob& job);
+
+    std::mutex _eegJobsMutex;
+    std::map<uint32_t, EEGLoadingJobPtr> _eegJobs;
+    uint32_t _nextEEGJobId{0};
 };
 #endif // BRAYNS_RESEARCH_MODULES_PLUGIN_H
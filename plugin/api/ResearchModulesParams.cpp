@@ -24,6 +24,9 @@
 
 #define FROM_JSON(PARAM, JSON, NAME) \
     PARAM.NAME = JSON[#NAME].get<decltype(PARAM.NAME)>()
+#define FROM_JSON_OPTIONAL(PARAM, JSON, NAME) \
+    if (JSON.find(#NAME) != JSON.end())        \
+    FROM_JSON(PARAM, JSON, NAME)
 #define TO_JSON(PARAM, JSON, NAME) JSON[#NAME] = PARAM.NAME;
 
 bool from_json(Result& param, const std::string& payload)
@@ -68,6 +71,75 @@ bool from_json(AttachEEGFile& param, const std::string& payload)
         FROM_JSON(param, js, path);
         FROM_JSON(param, js, scale);
         FROM_JSON(param, js, density);
+        FROM_JSON_OPTIONAL(param, js, dt);
+        FROM_JSON_OPTIONAL(param, js, timeWindow);
+    }
+    catch (...)
+    {
+        return false;
+    }
+    return true;
+}
+
+std::string to_json(const EEGFileJob& param)
+{
+    try
+    {
+        nlohmann::json js;
+
+        TO_JSON(param, js, success);
+        TO_JSON(param, js, error);
+        TO_JSON(param, js, jobId);
+        return js.dump();
+    }
+    catch (...)
+    {
+        return "";
+    }
+    return "";
+}
+
+std::string to_json(const EEGFileJobProgress& param)
+{
+    try
+    {
+        nlohmann::json js;
+
+        TO_JSON(param, js, jobId);
+        TO_JSON(param, js, state);
+        TO_JSON(param, js, progress);
+        TO_JSON(param, js, message);
+        return js.dump();
+    }
+    catch (...)
+    {
+        return "";
+    }
+    return "";
+}
+
+bool from_json(CancelEEGFileJob& param, const std::string& payload)
+{
+    try
+    {
+        auto js = nlohmann::json::parse(payload);
+        FROM_JSON(param, js, jobId);
+    }
+    catch (...)
+    {
+        return false;
+    }
+    return true;
+}
+
+bool from_json(ConvertEEGFile& param, const std::string& payload)
+{
+    try
+    {
+        auto js = nlohmann::json::parse(payload);
+        FROM_JSON(param, js, path);
+        FROM_JSON(param, js, outputPath);
+        FROM_JSON(param, js, scale);
     }
     catch (...)
     {
@@ -37,7 +37,40 @@ struct AttachEEGFile
     std::string path;
     double scale;
     double density;
+    double dt{0.0};
+    double timeWindow{0.0};
 };
 bool from_json(AttachEEGFile& attachEEGFile, const std::string& payload);
 
+struct EEGFileJob
+{
+    bool success{false};
+    std::string error;
+    uint32_t jobId{0};
+};
+std::string to_json(const EEGFileJob& eegFileJob);
+
+struct EEGFileJobProgress
+{
+    uint32_t jobId{0};
+    std::string state;
+    double progress{0.0};
+    std::string message;
+};
+std::string to_json(const EEGFileJobProgress& eegFileJobProgress);
+
+struct CancelEEGFileJob
+{
+    uint32_t jobId;
+};
+bool from_json(CancelEEGFileJob& cancelEEGFileJob, const std::string& payload);
+
+struct ConvertEEGFile
+{
+    std::string path;
+    std::string outputPath;
+    double scale;
+};
+bool from_json(ConvertEEGFile& convertEEGFile, const std::string& payload);
+
 #endif // RESEARCHMODULESPARAMS_H
@@ -24,77 +24,695 @@
 #include <plugin/log.h>
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
 #include <fstream>
-#include <sstream>
+#include <limits>
+#include <numeric>
+#include <thread>
 
-EEGHandler::EEGHandler(const std::string& filename, const float scale,
-                       const float density)
-    : brayns::AbstractSimulationHandler()
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
 {
-    std::ifstream file(filename);
-    if (!file.good())
-        PLUGIN_THROW("Could not open file " + filename)
+const char EEG_FILE_MAGIC[8] = {'B', 'R', 'A', 'Y', 'N', 'E', 'E', 'G'};
+const uint32_t EEG_FILE_VERSION = 1;
+
+// Text files are split into chunks of at least 1MB for parsing
+const size_t TEXT_CHUNK_MIN_SIZE = 1024 * 1024;
+
+// Interval at which loading progress is reported
+const std::chrono::milliseconds PROGRESS_INTERVAL(100);
+
+bool _isBinaryFile(const std::string& filename)
+{
+    std::ifstream file(filename, std::ios::binary);
+    char magic[sizeof(EEG_FILE_MAGIC)];
+    return file.read(magic, sizeof(magic)) &&
+           memcmp(magic, EEG_FILE_MAGIC, sizeof(magic)) == 0;
+}
+
+/**
+ * Stratified decimation: events are split into strata of 1/density
+ * consecutive events, and one event is kept per stratum. This keeps exactly
+ * floor(n * density) events, evenly spread over the file.
+ */
+bool _keepEvent(const size_t index, const float density)
+{
+    if (density >= 1.f)
+        return true;
+    return uint64_t((index + 1) * double(density)) !=
+           uint64_t(index * double(density));
+}
+
+/**
+ * Runs functor(i) for i in [0, nbTasks) on all cores. The calling thread
+ * periodically reports the ratio of completed tasks to the progress callback.
+ * If the callback throws, remaining tasks are abandoned and the exception is
+ * propagated once running tasks are completed.
+ */
+template <typename F>
+void _parallelFor(const size_t nbTasks, const F& functor,
+                  const std::function<void(float)>& progress = {})
+{
+    const size_t nbThreads =
+        std::min<size_t>(nbTasks, std::max(1u,
+                                           std::thread::hardware_concurrency()));
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> done{0};
+    std::atomic<bool> aborted{false};
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < nbThreads; ++i)
+        threads.emplace_back([&]() {
+            for (size_t task = next++; task < nbTasks && !aborted;
+                 task = next++)
+            {
+                functor(task);
+                if (++done == nbTasks)
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    condition.notify_one();
+                }
+            }
+        });
 
-    std::stringstream stream({std::istreambuf_iterator<char>(file),
-                              std::istreambuf_iterator<char>()});
-    size_t numlines = 0;
+    try
     {
-        numlines = std::count(std::istreambuf_iterator<char>(stream),
-                              std::istreambuf_iterator<char>(), '\n');
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!condition.wait_for(lock, PROGRESS_INTERVAL,
+                                   [&]() { return done == nbTasks; }))
+            if (progress)
+                progress(float(done) / nbTasks);
     }
-    stream.seekg(0);
-    size_t i = 0;
-    std::string line;
-    while (std::getline(stream, line))
+    catch (...)
     {
-        std::vector<float> lineData;
-        std::stringstream lineStream(line);
+        aborted = true;
+        for (auto& thread : threads)
+            thread.join();
+        throw;
+    }
+    for (auto& thread : threads)
+        thread.join();
+}
+
+bool _isBlank(const char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
 
-        float value;
-        while (lineStream >> value)
-            lineData.push_back(value);
+/**
+ * Locale independent parser for a float in decimal or scientific notation.
+ * Returns false if the characters at p do not form a number.
+ */
+bool _parseFloat(const char*& p, const char* end, float& value)
+{
+    const char* start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = (*p++ == '-');
 
-        switch (lineData.size())
+    uint64_t mantissa = 0;
+    int exponent = 0;
+    size_t nbDigits = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; ++p, ++nbDigits)
+        if (mantissa < 100000000000000000ull)
+            mantissa = mantissa * 10 + (*p - '0');
+        else
+            ++exponent;
+    if (p < end && *p == '.')
+        for (++p; p < end && *p >= '0' && *p <= '9'; ++p, ++nbDigits)
+            if (mantissa < 100000000000000000ull)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                --exponent;
+            }
+    if (nbDigits == 0)
+    {
+        p = start;
+        return false;
+    }
+
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        const char* e = p + 1;
+        bool negativeExponent = false;
+        if (e < end && (*e == '-' || *e == '+'))
+            negativeExponent = (*e++ == '-');
+        if (e < end && *e >= '0' && *e <= '9')
         {
-        case 3:
+            int power = 0;
+            for (; e < end && *e >= '0' && *e <= '9'; ++e)
+                power = std::min(power * 10 + (*e - '0'), 1000);
+            exponent += negativeExponent ? -power : power;
+            p = e;
+        }
+    }
+
+    double result = double(mantissa);
+    if (exponent != 0)
+        result *= std::pow(10.0, exponent);
+    value = float(negative ? -result : result);
+    return true;
+}
+
+struct TextChunk
+{
+    const char* begin;
+    const char* end;
+    size_t firstLine{0};
+    size_t nbLines{0};
+    size_t nbColumns{0};
+    brayns::floats events;
+    brayns::floats timestamps;
+    std::string error;
+};
+
+void _parseTextChunk(TextChunk& chunk, const float scale, const float density)
+{
+    size_t i = chunk.firstLine;
+    for (const char* line = chunk.begin; line < chunk.end; ++i)
+    {
+        const char* lineEnd = static_cast<const char*>(
+            memchr(line, '\n', chunk.end - line));
+        if (!lineEnd)
+            lineEnd = chunk.end;
+
+        float lineData[4];
+        size_t nbValues = 0;
+        const char* p = line;
+        while (true)
         {
-            if ((i * density) == static_cast<uint32_t>(i * density))
+            while (p < lineEnd && _isBlank(*p))
+                ++p;
+            if (p == lineEnd)
+                break;
+            float value;
+            if (!_parseFloat(p, lineEnd, value) ||
+                (p < lineEnd && !_isBlank(*p)))
             {
-                _frameData.push_back(lineData[0] * scale);
-                _frameData.push_back(lineData[1] * scale);
-                _frameData.push_back(lineData[2] * scale);
+                nbValues = 0;
+                break;
             }
-            break;
+            if (nbValues < 4)
+                lineData[nbValues] = value;
+            ++nbValues;
+        }
+
+        // All lines of a chunk must have the same number of values
+        if (chunk.nbColumns == 0)
+            chunk.nbColumns = nbValues;
+        if ((nbValues != 3 && nbValues != 4) || nbValues != chunk.nbColumns)
+        {
+            chunk.error = "Invalid content in line " + std::to_string(i + 1) +
+                          ": " + std::string(line, lineEnd);
+            return;
         }
-        default:
-            PLUGIN_THROW("Invalid content in line " + std::to_string(i + 1) +
-                         ": " + line);
+
+        if (_keepEvent(i, density))
+        {
+            chunk.events.push_back(lineData[0] * scale);
+            chunk.events.push_back(lineData[1] * scale);
+            chunk.events.push_back(lineData[2] * scale);
+            if (nbValues == 4)
+                chunk.timestamps.push_back(lineData[3]);
         }
-        ++i;
+        line = lineEnd + 1;
+    }
+}
+
+/**
+ * Loads x, y, z events from a text file. If lines have a fourth value, it is
+ * the timestamp of the event, and events are returned sorted by timestamp.
+ */
+void _loadTextFile(const std::string& filename, const float scale,
+                   const float density, brayns::floats& events,
+                   brayns::floats& timestamps,
+                   const EEGProgressCallback& callback)
+{
+    const auto progress = [&](const std::string& message, const float begin,
+                              const float end) {
+        return [&callback, message, begin, end](const float value) {
+            if (callback)
+                callback(message, begin + value * (end - begin));
+        };
+    };
+
+    const int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1)
+        PLUGIN_THROW("Could not open file " + filename)
+
+    struct stat status;
+    if (fstat(fd, &status) == -1)
+    {
+        close(fd);
+        PLUGIN_THROW("Could not read file " + filename)
+    }
+    const size_t size = status.st_size;
+    if (size == 0)
+    {
+        close(fd);
+        return;
+    }
+
+    void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        PLUGIN_THROW("Could not map file " + filename)
+    std::shared_ptr<void> mapping(data,
+                                  [size](void* ptr) { munmap(ptr, size); });
+    madvise(data, size, MADV_SEQUENTIAL);
+
+    // Split the file into newline aligned chunks
+    const char* begin = static_cast<const char*>(data);
+    const char* end = begin + size;
+    const size_t nbChunks = std::max<size_t>(
+        1, std::min<size_t>(size / TEXT_CHUNK_MIN_SIZE,
+                            4 * std::thread::hardware_concurrency()));
+    std::vector<TextChunk> chunks;
+    const char* chunkBegin = begin;
+    for (size_t i = 1; i <= nbChunks && chunkBegin < end; ++i)
+    {
+        const char* chunkEnd = end;
+        if (i < nbChunks)
+        {
+            chunkEnd = std::max(chunkBegin, begin + i * size / nbChunks);
+            const char* newline = static_cast<const char*>(
+                memchr(chunkEnd, '\n', end - chunkEnd));
+            chunkEnd = newline ? newline + 1 : end;
+        }
+        TextChunk chunk;
+        chunk.begin = chunkBegin;
+        chunk.end = chunkEnd;
+        chunks.push_back(chunk);
+        chunkBegin = chunkEnd;
+    }
+
+    // Line numbers are needed for the decimation and error reporting
+    _parallelFor(chunks.size(),
+                 [&](const size_t i) {
+                     auto& chunk = chunks[i];
+                     chunk.nbLines = std::count(chunk.begin, chunk.end, '\n');
+                     if (chunk.end == end && *(end - 1) != '\n')
+                         ++chunk.nbLines;
+                 },
+                 progress("Counting lines", 0.f, 0.1f));
+    for (size_t i = 1; i < chunks.size(); ++i)
+        chunks[i].firstLine = chunks[i - 1].firstLine + chunks[i - 1].nbLines;
+
+    _parallelFor(chunks.size(),
+                 [&](const size_t i) {
+                     _parseTextChunk(chunks[i], scale, density);
+                 },
+                 progress("Parsing events", 0.1f, 0.9f));
+
+    // Merge chunks in file order
+    size_t nbValues = 0;
+    size_t nbTimestamps = 0;
+    std::vector<size_t> offsets;
+    std::vector<size_t> timestampOffsets;
+    for (const auto& chunk : chunks)
+    {
+        if (!chunk.error.empty())
+            PLUGIN_THROW(chunk.error)
+        if (chunk.nbColumns != chunks[0].nbColumns)
+            PLUGIN_THROW("Invalid number of values in line " +
+                         std::to_string(chunk.firstLine + 1))
+        offsets.push_back(nbValues);
+        timestampOffsets.push_back(nbTimestamps);
+        nbValues += chunk.events.size();
+        nbTimestamps += chunk.timestamps.size();
+    }
+
+    events.resize(nbValues);
+    timestamps.resize(nbTimestamps);
+    _parallelFor(chunks.size(),
+                 [&](const size_t i) {
+                     std::copy(chunks[i].events.begin(),
+                               chunks[i].events.end(),
+                               events.begin() + offsets[i]);
+                     std::copy(chunks[i].timestamps.begin(),
+                               chunks[i].timestamps.end(),
+                               timestamps.begin() + timestampOffsets[i]);
+                     brayns::floats().swap(chunks[i].events);
+                     brayns::floats().swap(chunks[i].timestamps);
+                 },
+                 progress("Merging events", 0.9f, 0.95f));
+
+    if (timestamps.empty() ||
+        std::is_sorted(timestamps.begin(), timestamps.end()))
+        return;
+
+    if (callback)
+        callback("Sorting events", 0.95f);
+
+    // Frames are contiguous ranges of events sorted by timestamp
+    std::vector<uint64_t> order(timestamps.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+                     [&](const uint64_t a, const uint64_t b) {
+                         return timestamps[a] < timestamps[b];
+                     });
+    brayns::floats sortedEvents(events.size());
+    brayns::floats sortedTimestamps(timestamps.size());
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        sortedTimestamps[i] = timestamps[order[i]];
+        for (size_t j = 0; j < 3; ++j)
+            sortedEvents[i * 3 + j] = events[order[i] * 3 + j];
+    }
+    events.swap(sortedEvents);
+    timestamps.swap(sortedTimestamps);
+}
+} // namespace
+
+EEGHandler::EEGHandler(const std::string& filename, const float scale,
+                       const float density, const double dt,
+                       const double timeWindow,
+                       const EEGProgressCallback& callback)
+    : brayns::AbstractSimulationHandler()
+{
+    if (_isBinaryFile(filename))
+        _loadBinaryFile(filename, scale, density);
+    else
+    {
+        brayns::floats events;
+        brayns::floats timestamps;
+        _loadTextFile(filename, scale, density, events, timestamps, callback);
+        _setEvents(std::move(events), std::move(timestamps));
     }
-    _nbFrames = 0;
-    _dt = 0.f;
     _unit = "None";
-    _frameSize = _frameData.size();
-    PLUGIN_INFO << filename << " was successfully loaded (" << _frameSize / 3
-                << " events, scale=" << scale << ")" << std::endl;
+    _initializeFrames(dt, timeWindow);
+    _buildLevelsOfDetail();
+    PLUGIN_INFO << filename << " was successfully loaded (" << _nbEvents
+                << " events, scale=" << scale << ", frames=" << _nbFrames
+                << ")" << std::endl;
+}
+
+void EEGHandler::_loadBinaryFile(const std::string& filename,
+                                 const float scale, const float density)
+{
+    const int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1)
+        PLUGIN_THROW("Could not open file " + filename)
+
+    struct stat status;
+    if (fstat(fd, &status) == -1 ||
+        size_t(status.st_size) < sizeof(EEGFileHeader))
+    {
+        close(fd);
+        PLUGIN_THROW("Invalid binary EEG file " + filename)
+    }
+
+    const size_t size = status.st_size;
+    void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        PLUGIN_THROW("Could not map file " + filename)
+    std::shared_ptr<const void> mapping(data, [size](const void* ptr) {
+        munmap(const_cast<void*>(ptr), size);
+    });
+
+    const auto header = static_cast<const EEGFileHeader*>(data);
+    if (header->version != EEG_FILE_VERSION)
+        PLUGIN_THROW("Unsupported binary EEG file version " +
+                     std::to_string(header->version) + " in " + filename)
+    const bool hasTimestamps = header->flags & EEG_FILE_HAS_TIMESTAMPS;
+    const size_t nbValuesPerEvent = hasTimestamps ? 4 : 3;
+    // Compared by division, since the size of the events of a corrupted
+    // header may overflow
+    if (header->nbEvents > (size - sizeof(EEGFileHeader)) /
+                               (nbValuesPerEvent * sizeof(float)))
+        PLUGIN_THROW("Truncated binary EEG file " + filename)
+
+    const float* events = reinterpret_cast<const float*>(header + 1);
+    const float* timestamps =
+        hasTimestamps ? events + header->nbEvents * 3 : nullptr;
+    if (scale == header->scale && density >= 1.f)
+    {
+        // Events are exposed directly from the mapped file
+        _storage = mapping;
+        _mapped = true;
+        _events = events;
+        _eventTimestamps = timestamps;
+        _nbEvents = header->nbEvents;
+        return;
+    }
+
+    // A different scale or a decimation requires a copy of the events
+    const float factor = scale / header->scale;
+    brayns::floats keptEvents;
+    brayns::floats keptTimestamps;
+    for (size_t i = 0; i < header->nbEvents; ++i)
+        if (_keepEvent(i, density))
+        {
+            for (size_t j = 0; j < 3; ++j)
+                keptEvents.push_back(events[i * 3 + j] * factor);
+            if (timestamps)
+                keptTimestamps.push_back(timestamps[i]);
+        }
+    _setEvents(std::move(keptEvents), std::move(keptTimestamps));
+}
+
+void EEGHandler::_setEvents(brayns::floats&& events,
+                            brayns::floats&& timestamps)
+{
+    struct Buffers
+    {
+        brayns::floats events;
+        brayns::floats timestamps;
+    };
+    auto buffers = std::make_shared<Buffers>();
+    buffers->events = std::move(events);
+    buffers->timestamps = std::move(timestamps);
+
+    _events = buffers->events.data();
+    _eventTimestamps =
+        buffers->timestamps.empty() ? nullptr : buffers->timestamps.data();
+    _nbEvents = buffers->events.size() / 3;
+    _storage = buffers;
+    _mapped = false;
+}
+
+void EEGHandler::_initializeFrames(const double dt, const double timeWindow)
+{
+    _nbFrames = 0;
+    _dt = 0.0;
+    _frameSize = _nbEvents * 3;
+    if (!_eventTimestamps || _nbEvents == 0 || dt <= 0.0)
+        return;
+
+    if (!std::is_sorted(_eventTimestamps, _eventTimestamps + _nbEvents))
+        PLUGIN_THROW("Events are not sorted by timestamp")
+
+    _dt = dt;
+    _timeWindow = timeWindow > 0.0 ? timeWindow : dt;
+    _startTime = _eventTimestamps[0];
+    const double duration = _eventTimestamps[_nbEvents - 1] - _startTime;
+    _nbFrames = uint32_t(duration / _dt) + 1;
+    _startPrefetching();
+}
+
+void EEGHandler::_buildLevelsOfDetail()
+{
+    std::vector<uint64_t> intervals{0};
+    for (uint32_t i = 1; i < _nbFrames; ++i)
+        intervals.push_back(std::lower_bound(_eventTimestamps,
+                                             _eventTimestamps + _nbEvents,
+                                             _startTime + i * _dt) -
+                            _eventTimestamps);
+    intervals.push_back(_nbEvents);
+    if (_nbFrames > 0)
+        _windowIntervals =
+            std::max(1u, uint32_t(std::floor(_timeWindow / _dt + 1e-3)));
+    _levelsOfDetail = std::make_shared<const brayns::EventLevelsOfDetail>(
+        _events, _nbEvents, intervals);
+}
+
+EEGHandler::FrameRange EEGHandler::_getFrameRange(const uint32_t frame) const
+{
+    FrameRange range;
+    range.last = _nbEvents;
+    if (_nbFrames == 0)
+        return range;
+
+    // Frame N displays the events of the time window ending at the end of
+    // the N-th interval of duration dt
+    const double end = _startTime + (frame + 1) * _dt;
+    const double begin = end - _timeWindow;
+    const float* timestamps = _eventTimestamps;
+    range.first =
+        std::lower_bound(timestamps, timestamps + _nbEvents, begin) -
+        timestamps;
+    range.last =
+        std::lower_bound(timestamps, timestamps + _nbEvents, end) - timestamps;
+    return range;
+}
+
+void EEGHandler::_startPrefetching()
+{
+    // Only events read from the mapped file benefit from being touched
+    // ahead of time
+    if (_mapped && _nbFrames > 1)
+        _prefetchThread = std::thread(&EEGHandler::_prefetch, this);
+}
+
+void EEGHandler::_prefetch()
+{
+    std::unique_lock<std::mutex> lock(_prefetchMutex);
+    while (true)
+    {
+        _prefetchCondition.wait(lock, [&]() {
+            return _terminatePrefetching ||
+                   (!_prefetched || _prefetchFrame != _prefetchedFrame);
+        });
+        if (_terminatePrefetching)
+            return;
+
+        const uint32_t frame = _prefetchFrame;
+        lock.unlock();
+        const auto range = _getFrameRange(frame);
+        if (_mapped && range.last > range.first)
+        {
+            // Fault in the pages of the mapped events of the frame so that
+            // rendering does not wait for the disk
+            const size_t pageSize = sysconf(_SC_PAGESIZE);
+            const char* begin =
+                reinterpret_cast<const char*>(_events + range.first * 3);
+            const char* end =
+                reinterpret_cast<const char*>(_events + range.last * 3);
+            char* alignedBegin = reinterpret_cast<char*>(
+                reinterpret_cast<uintptr_t>(begin) & ~(pageSize - 1));
+            madvise(alignedBegin, end - alignedBegin, MADV_WILLNEED);
+            volatile char sum = 0;
+            for (const char* page = alignedBegin; page < end; page += pageSize)
+                sum += *page;
+        }
+        lock.lock();
+        _prefetchedFrame = frame;
+        _prefetchedRange = range;
+        _prefetched = true;
+    }
+}
+
+void EEGHandler::convert(const std::string& input, const std::string& output,
+                         const float scale,
+                         const EEGProgressCallback& callback)
+{
+    brayns::floats events;
+    brayns::floats timestamps;
+    _loadTextFile(input, scale, 1.f, events, timestamps, callback);
+
+    EEGFileHeader header{};
+    memcpy(header.magic, EEG_FILE_MAGIC, sizeof(header.magic));
+    header.version = EEG_FILE_VERSION;
+    header.flags = timestamps.empty() ? 0 : EEG_FILE_HAS_TIMESTAMPS;
+    header.nbEvents = events.size() / 3;
+    header.scale = scale;
+    for (size_t i = 0; i < 3; ++i)
+    {
+        header.bounds[i] = std::numeric_limits<float>::max();
+        header.bounds[i + 3] = -std::numeric_limits<float>::max();
+    }
+    for (size_t i = 0; i < events.size(); ++i)
+    {
+        header.bounds[i % 3] = std::min(header.bounds[i % 3], events[i]);
+        header.bounds[i % 3 + 3] =
+            std::max(header.bounds[i % 3 + 3], events[i]);
+    }
+
+    std::ofstream file(output, std::ios::binary);
+    if (!file.good())
+        PLUGIN_THROW("Could not create file " + output)
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(events.data()),
+               events.size() * sizeof(float));
+    file.write(reinterpret_cast<const char*>(timestamps.data()),
+               timestamps.size() * sizeof(float));
+    if (!file.good())
+        PLUGIN_THROW("Failed to write file " + output)
+
+    PLUGIN_INFO << input << " was successfully converted to " << output
+                << " (" << header.nbEvents << " events, scale=" << scale
+                << ")" << std::endl;
 }
 
 EEGHandler::EEGHandler(const EEGHandler& rhs)
     : brayns::AbstractSimulationHandler(rhs)
+    , _storage(rhs._storage)
+    , _mapped(rhs._mapped)
+    , _events(rhs._events)
+    , _eventTimestamps(rhs._eventTimestamps)
+    , _nbEvents(rhs._nbEvents)
+    , _startTime(rhs._startTime)
+    , _timeWindow(rhs._timeWindow)
+    , _levelsOfDetail(rhs._levelsOfDetail)
+    , _windowIntervals(rhs._windowIntervals)
 {
+    // The clone has not delivered any frame yet
+    _currentFrame = std::numeric_limits<uint32_t>::max();
+    _startPrefetching();
 }
 
-EEGHandler::~EEGHandler() {}
+EEGHandler::~EEGHandler()
+{
+    if (_prefetchThread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(_prefetchMutex);
+            _terminatePrefetching = true;
+        }
+        _prefetchCondition.notify_one();
+        _prefetchThread.join();
+    }
+}
 
 void* EEGHandler::getFrameData(const uint32_t frame)
 {
-    if (!_initialized)
+    const uint32_t boundedFrame = _nbFrames == 0 ? 0 : frame % _nbFrames;
+    if (boundedFrame == _currentFrame)
+        return nullptr;
+
+    FrameRange range;
+    bool prefetched = false;
+    if (_prefetchThread.joinable())
     {
-        _initialized = true;
-        return _frameData.data();
+        std::lock_guard<std::mutex> lock(_prefetchMutex);
+        if (_prefetched && _prefetchedFrame == boundedFrame)
+        {
+            range = _prefetchedRange;
+            prefetched = true;
+        }
+        _prefetchFrame = (boundedFrame + 1) % _nbFrames;
     }
-    return nullptr;
+    _prefetchCondition.notify_one();
+    if (!prefetched)
+        range = _getFrameRange(boundedFrame);
+
+    _currentFrame = boundedFrame;
+    _frameSize = (range.last - range.first) * 3;
+
+    brayns::EventLevelsOfDetail::Frame lodFrame;
+    lodFrame.levels = _levelsOfDetail;
+    lodFrame.lastInterval = boundedFrame + 1;
+    lodFrame.firstInterval =
+        lodFrame.lastInterval - std::min(lodFrame.lastInterval,
+                                         size_t(_windowIntervals));
+    lodFrame.nbEvents = range.last - range.first;
+    brayns::EventLevelsOfDetail::publish(lodFrame);
+
+    // An empty frame still needs a valid pointer, since nullptr means that
+    // the frame is unchanged
+    static float noEvents[3] = {0.f, 0.f, 0.f};
+    if (!_events)
+        return noEvents;
+    return const_cast<float*>(_events + range.first * 3);
 }
 
 brayns::AbstractSimulationHandlerPtr EEGHandler::clone() const
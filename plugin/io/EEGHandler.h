@@ -27,6 +27,38 @@
 #include <brayns/api.h>
 #include <brayns/common/types.h>
 
+#include <common/io/EventLevelsOfDetail.h>
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+/**
+ * @brief Header of the binary EEG event format. The header is followed by
+ * nbEvents tightly packed x, y, z float triplets, already multiplied by scale.
+ * If flags contains EEG_FILE_HAS_TIMESTAMPS, positions are followed by one
+ * float timestamp per event, and events are sorted by timestamp.
+ */
+struct EEGFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint64_t nbEvents;
+    float bounds[6];
+    float scale;
+    uint32_t padding;
+};
+
+const uint32_t EEG_FILE_HAS_TIMESTAMPS = 1;
+
+/**
+ * @brief Reports the loading progress, between 0 and 1, with a message
+ * describing the current step. Loading is aborted if the callback throws.
+ */
+typedef std::function<void(const std::string&, float)> EEGProgressCallback;
+
 /**
  * @brief The EEGHandler class handles distance to the soma
  */
@@ -35,20 +67,96 @@ class EEGHandler : public brayns::AbstractSimulationHandler
 public:
     /**
      * @brief Default constructor
+     * @param filename Text or binary EEG file
+     * @param scale Scale applied to event positions
+     * @param density Ratio of events to keep, evenly spread over the file.
+     * Spatial levels of detail of the kept events are built once, and
+     * published with every frame for the voxelizer renderer
+     * @param dt Duration of a frame. If events are timestamped and dt is
+     * positive, events are bucketed by timestamp into frames
+     * @param timeWindow Duration of the sliding window of events displayed
+     * in a frame. Defaults to dt if not positive
+     * @param callback Loading progress callback
      */
     EEGHandler(const std::string& filename, const float scale,
-               const float density);
+               const float density, const double dt = 0.0,
+               const double timeWindow = 0.0,
+               const EEGProgressCallback& callback = {});
     EEGHandler(const EEGHandler& rhs);
     ~EEGHandler();
 
-    void* getFrameData(const uint32_t) final;
+    /**
+     * @brief Converts a text file of whitespace separated x, y, z events,
+     * optionally followed by a timestamp, into the binary EEG event format
+     * @param input Text file to convert
+     * @param output Binary file to write
+     * @param scale Scale applied to event positions
+     * @param callback Progress callback of the parsing of the text file.
+     * Conversion is aborted if the callback throws
+     */
+    static void convert(const std::string& input, const std::string& output,
+                        const float scale,
+                        const EEGProgressCallback& callback = {});
+
+    /**
+     * @brief Returns the events of the given frame. Events of a frame are
+     * contiguous in memory, and the frame size is updated accordingly. A
+     * frame without events returns a valid pointer and a null frame size.
+     * Returns nullptr only if the frame is the one that was previously
+     * returned
+     */
+    void* getFrameData(const uint32_t frame) final;
 
     bool isReady() const final { return true; }
 
     brayns::AbstractSimulationHandlerPtr clone() const final;
 
 private:
-    bool _initialized{false};
+    struct FrameRange
+    {
+        uint64_t first{0};
+        uint64_t last{0};
+    };
+
+    void _loadBinaryFile(const std::string& filename, const float scale,
+                         const float density);
+    void _initializeFrames(const double dt, const double timeWindow);
+    void _buildLevelsOfDetail();
+    FrameRange _getFrameRange(const uint32_t frame) const;
+    void _startPrefetching();
+    void _prefetch();
+
+    void _setEvents(brayns::floats&& events, brayns::floats&& timestamps);
+
+    // Immutable storage of the events, either a memory mapped binary file or
+    // loaded events, shared with clones. The base class frame data is never
+    // used so that cloning does not copy events
+    std::shared_ptr<const void> _storage;
+    bool _mapped{false};
+
+    const float* _events{nullptr};
+    const float* _eventTimestamps{nullptr};
+    uint64_t _nbEvents{0};
+
+    // Frames
+    double _startTime{0.0};
+    double _timeWindow{0.0};
+
+    // Levels of detail, shared with clones. Their intervals are the frame
+    // intervals of duration dt, and a frame covers the last _windowIntervals
+    // intervals of its time window
+    std::shared_ptr<const brayns::EventLevelsOfDetail> _levelsOfDetail;
+    uint32_t _windowIntervals{1};
+
+    // Background preparation of the frame following the current one
+    std::thread _prefetchThread;
+    std::mutex _prefetchMutex;
+    std::condition_variable _prefetchCondition;
+    bool _terminatePrefetching{false};
+    uint32_t _prefetchFrame{0};
+    uint32_t _prefetchedFrame{0};
+    bool _prefetched{false};
+    FrameRange _prefetchedRange;
 };
 typedef std::shared_ptr<EEGHandler> EEGHandlerPtr;
 
@@ -33,22 +33,13 @@ namespace brayns
 {
 void TransparencyRenderer::commit()
 {
-    AbstractRenderer::commit();
+    SimulationRenderer::commit();
 
-    _simulationData = getParamData("simulationData");
-    _simulationDataSize = getParam1i("simulationDataSize", 0);
-    _transferFunctionDiffuseData = getParamData("transferFunctionDiffuseData");
-    _transferFunctionEmissionData =
-        getParamData("transferFunctionEmissionData");
-    _transferFunctionSize = getParam1i("transferFunctionSize", 0);
-    _transferFunctionMinValue = getParam1f("transferFunctionMinValue", 0.f);
-    _transferFunctionRange = getParam1f("transferFunctionRange", 0.f);
     _threshold = getParam1f("threshold", _transferFunctionMinValue);
 
     ispc::TransparencyRenderer_set(
         getIE(), (_bgMaterial ? _bgMaterial->getIE() : nullptr), rand() % 100,
-        _timestamp, spp, _simulationData ? (float*)_simulationData->data : NULL,
-        _simulationDataSize,
+        _timestamp, spp,
         _transferFunctionDiffuseData
             ? (ispc::vec4f*)_transferFunctionDiffuseData->data
             : NULL,
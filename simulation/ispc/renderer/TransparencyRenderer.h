@@ -21,11 +21,11 @@
 
 #pragma once
 
-#include <common/ispc/renderer/AbstractRenderer.h>
+#include <common/ispc/renderer/SimulationRenderer.h>
 
 namespace brayns
 {
-class TransparencyRenderer : public AbstractRenderer
+class TransparencyRenderer : public SimulationRenderer
 {
 public:
     TransparencyRenderer();
@@ -41,15 +41,6 @@ public:
     void commit() final;
 
 private:
-    ospray::Ref<ospray::Data> _simulationData;
-    ospray::uint64 _simulationDataSize;
-
-    // Transfer function
-    ospray::Ref<ospray::Data> _transferFunctionDiffuseData;
-    ospray::Ref<ospray::Data> _transferFunctionEmissionData;
-    float _transferFunctionMinValue;
-    float _transferFunctionRange;
-    ospray::int32 _transferFunctionSize;
     float _threshold;
 };
 
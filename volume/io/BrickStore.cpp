@@ -0,0 +1,273 @@
+/* Copyright (c) 2018, Cyrille Favreau
+ * All rights reserved. Do not distribute without permission.
+ * Responsible Author: Cyrille Favreau <cyrille.favreau@gmail.com>
+ *
+ * This file is part of the reseach Brayns module
+ * <https://github.com/favreau/Brayns-Research-Modules>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "BrickStore.h"
+
+#include <plugin/log.h>
+
+#include <ospray/ospcommon/tasking/parallel_for.h>
+
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace ospray;
+
+namespace brayns
+{
+// Maximum number of loaded bricks waiting to be moved into the pool
+const size_t MAX_LOADED_BRICKS = 4096;
+
+const size_t BRICK_VOXELS = BRICK_SIZE * BRICK_SIZE * BRICK_SIZE;
+
+const uint32 BrickStore::NO_SLOT;
+
+BrickStore::BrickStore(const std::string& filename, const vec3i& dimensions,
+                       const size_t cacheSize)
+    : _filename(filename)
+    , _dimensions(dimensions)
+    , _bricks((dimensions + vec3i(BRICK_SIZE - 1)) / BRICK_SIZE)
+{
+    if (reduce_min(dimensions) <= 0)
+        PLUGIN_THROW("Invalid dimensions for volume " + filename)
+
+    const int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1)
+        PLUGIN_THROW("Could not open file " + filename)
+
+    struct stat status;
+    if (fstat(fd, &status) == -1)
+    {
+        close(fd);
+        PLUGIN_THROW("Could not read file " + filename)
+    }
+    _size = size_t(dimensions.x) * dimensions.y * dimensions.z;
+    if (size_t(status.st_size) < _size)
+    {
+        close(fd);
+        PLUGIN_THROW("Truncated volume file " + filename)
+    }
+
+    void* data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        PLUGIN_THROW("Could not map file " + filename)
+    _voxels = static_cast<const uint8*>(data);
+
+    _buildCoarseVolume();
+    madvise(data, _size, MADV_RANDOM);
+
+    const size_t nbBricks = size_t(_bricks.x) * _bricks.y * _bricks.z;
+    const size_t nbSlots =
+        std::max<size_t>(1, std::min(nbBricks, cacheSize / BRICK_VOXELS));
+    _pageTable.resize(nbBricks, NO_SLOT);
+    _states.resize(nbBricks, BrickState::missing);
+    _pool.resize(nbSlots * BRICK_VOXELS, 0);
+    _slotBricks.resize(nbSlots, NO_SLOT);
+    _slotFrames.resize(nbSlots, 0);
+    for (uint32 slot = 0; slot < nbSlots; ++slot)
+        _lruPositions.push_back(_lru.insert(_lru.end(), slot));
+
+    PLUGIN_INFO << "Streaming " << _size / (1024 * 1024) << " MB volume "
+                << filename << " through a " << nbSlots << " bricks cache"
+                << std::endl;
+
+    _loader = std::thread(&BrickStore::_load, this);
+}
+
+BrickStore::~BrickStore()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopped = true;
+    }
+    _condition.notify_all();
+    _loader.join();
+    munmap(const_cast<uint8*>(_voxels), _size);
+}
+
+size_t BrickStore::getMortonCode(const int x, const int y, const int z)
+{
+    size_t code = 0;
+    for (int bit = 0; (1 << bit) < BRICK_SIZE; ++bit)
+        code |= (((x >> bit) & 1) << (3 * bit)) |
+                (((y >> bit) & 1) << (3 * bit + 1)) |
+                (((z >> bit) & 1) << (3 * bit + 2));
+    return code;
+}
+
+void BrickStore::_buildCoarseVolume()
+{
+    // Each coarse voxel is the average of the COARSE_FACTOR^3 voxels it
+    // covers. The file is read once, sequentially within each slice
+    madvise(const_cast<uint8*>(_voxels), _size, MADV_SEQUENTIAL);
+    _coarseDimensions =
+        (_dimensions + vec3i(COARSE_FACTOR - 1)) / COARSE_FACTOR;
+    const vec3i& coarse = _coarseDimensions;
+    _coarseVolume.resize(size_t(coarse.x) * coarse.y * coarse.z);
+
+    tasking::parallel_for(coarse.z, [&](int cz) {
+        std::vector<uint32> sums(size_t(coarse.x) * coarse.y);
+        std::vector<uint32> counts(sums.size());
+        const int z1 = std::min(_dimensions.z, (cz + 1) * COARSE_FACTOR);
+        for (int z = cz * COARSE_FACTOR; z < z1; ++z)
+            for (int y = 0; y < _dimensions.y; ++y)
+            {
+                const uint8* row =
+                    _voxels + (size_t(z) * _dimensions.y + y) * _dimensions.x;
+                const size_t offset = size_t(y / COARSE_FACTOR) * coarse.x;
+                for (int x = 0; x < _dimensions.x; ++x)
+                {
+                    sums[offset + x / COARSE_FACTOR] += row[x];
+                    ++counts[offset + x / COARSE_FACTOR];
+                }
+            }
+        uint8* slice = _coarseVolume.data() + size_t(cz) * sums.size();
+        for (size_t i = 0; i < sums.size(); ++i)
+            slice[i] = counts[i] ? sums[i] / counts[i] : 0;
+    });
+}
+
+void BrickStore::_readBrick(const uint32 brick, uint8* voxels) const
+{
+    const vec3i index(brick % _bricks.x, (brick / _bricks.x) % _bricks.y,
+                      brick / (size_t(_bricks.x) * _bricks.y));
+    const vec3i lower = index * BRICK_SIZE;
+    const vec3i upper = min(lower + vec3i(BRICK_SIZE), _dimensions);
+
+    // Voxels of partial bricks at the volume boundary are never sampled
+    memset(voxels, 0, BRICK_VOXELS);
+    for (int z = lower.z; z < upper.z; ++z)
+        for (int y = lower.y; y < upper.y; ++y)
+        {
+            const uint8* row =
+                _voxels + (size_t(z) * _dimensions.y + y) * _dimensions.x;
+            for (int x = lower.x; x < upper.x; ++x)
+                voxels[getMortonCode(x - lower.x, y - lower.y, z - lower.z)] =
+                    row[x];
+        }
+}
+
+void BrickStore::_load()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true)
+    {
+        _condition.wait(lock, [this] {
+            return _stopped ||
+                   (!_queue.empty() && _loaded.size() < MAX_LOADED_BRICKS);
+        });
+        if (_stopped)
+            return;
+
+        const uint32 brick = _queue.front();
+        _queue.pop_front();
+        if (_states[brick] != BrickState::missing)
+            continue;
+        _states[brick] = BrickState::loading;
+
+        // Page faults of the mapping are taken without holding the lock
+        std::vector<uint8> voxels(BRICK_VOXELS);
+        lock.unlock();
+        _readBrick(brick, voxels.data());
+        lock.lock();
+
+        _states[brick] = BrickState::loaded;
+        _loaded.emplace_back(brick, std::move(voxels));
+    }
+}
+
+void BrickStore::prefetch(const std::vector<uint32>& bricks)
+{
+    ++_frame;
+    for (const auto brick : bricks)
+    {
+        const uint32 slot = _pageTable[brick];
+        if (slot == NO_SLOT)
+            continue;
+        _slotFrames[slot] = _frame;
+        _lru.splice(_lru.begin(), _lru, _lruPositions[slot]);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _queue.clear();
+        for (const auto brick : bricks)
+            if (_states[brick] == BrickState::missing)
+                _queue.push_back(brick);
+    }
+    _condition.notify_one();
+}
+
+bool BrickStore::update(bool& dropped)
+{
+    dropped = false;
+    decltype(_loaded) loaded;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        loaded.swap(_loaded);
+    }
+    if (loaded.empty())
+        return false;
+
+    // Bricks recycle the least recently used slots, unless those are used
+    // by the current frame, in which case the remaining bricks are dropped
+    // and must be queued again by the next prefetch
+    std::vector<uint32> resident;
+    std::vector<uint32> missing;
+    for (auto& brick : loaded)
+    {
+        const uint32 slot = _lru.back();
+        if (_slotFrames[slot] == _frame)
+        {
+            missing.push_back(brick.first);
+            dropped = true;
+            continue;
+        }
+
+        if (_slotBricks[slot] != NO_SLOT)
+        {
+            _pageTable[_slotBricks[slot]] = NO_SLOT;
+            missing.push_back(_slotBricks[slot]);
+        }
+        memcpy(_pool.data() + size_t(slot) * BRICK_VOXELS,
+               brick.second.data(), BRICK_VOXELS);
+        _slotBricks[slot] = brick.first;
+        _slotFrames[slot] = _frame;
+        _pageTable[brick.first] = slot;
+        _lru.splice(_lru.begin(), _lru, _lruPositions[slot]);
+        resident.push_back(brick.first);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (const auto brick : resident)
+            _states[brick] = BrickState::resident;
+        for (const auto brick : missing)
+            _states[brick] = BrickState::missing;
+    }
+    _condition.notify_one();
+    return !resident.empty();
+}
+} // namespace brayns
@@ -0,0 +1,145 @@
+/* Copyright (c) 2018, Cyrille Favreau
+ * All rights reserved. Do not distribute without permission.
+ * Responsible Author: Cyrille Favreau <cyrille.favreau@gmail.com>
+ *
+ * This file is part of the reseach Brayns module
+ * <https://github.com/favreau/Brayns-Research-Modules>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include <ospray/SDK/common/Data.h>
+
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace brayns
+{
+// Number of voxels of a brick along one axis. Must match BRICK_SIZE in
+// VolumeRenderer.ispc
+const int BRICK_SIZE = 8;
+
+// Downsampling factor of the resident coarse copy of a streamed volume. Must
+// match COARSE_FACTOR in VolumeRenderer.ispc
+const int COARSE_FACTOR = 4;
+
+/**
+    Paged store of the bricks of a raw 8-bit volume file that does not fit in
+    memory. The file is memory-mapped, and bricks are copied by a loader
+    thread into a fixed pool of slots, recycled in least recently used order.
+    A page table maps every brick to its slot, or to NO_SLOT while it is not
+    resident, and a coarse copy of the volume stays resident for the missing
+    bricks. Streaming bounds the memory used by the volume, not its loading
+    time: the coarse copy is built by a full sequential pass over the file
+    when the store is created
+*/
+class BrickStore
+{
+public:
+    static const ospray::uint32 NO_SLOT = 0xFFFFFFFF;
+
+    /**
+       Maps the given file and builds the coarse copy of the volume, reading
+       the whole file once
+       @param filename Raw file of 8-bit voxels, in x-fastest order
+       @param dimensions Dimensions of the volume, in voxels
+       @param cacheSize Size of the brick pool, in bytes
+    */
+    BrickStore(const std::string& filename, const ospray::vec3i& dimensions,
+               const size_t cacheSize);
+    ~BrickStore();
+
+    /** Position of a voxel within its brick, with interleaved coordinate bits
+     */
+    static size_t getMortonCode(const int x, const int y, const int z);
+
+    const std::string& getFilename() const { return _filename; }
+    const ospray::vec3i& getDimensions() const { return _dimensions; }
+    const ospray::uint8* getVoxels() const { return _voxels; }
+    const ospray::vec3i& getBrickDimensions() const { return _bricks; }
+    const ospray::uint32* getPageTable() const { return _pageTable.data(); }
+    const ospray::uint8* getPool() const { return _pool.data(); }
+    size_t getNbSlots() const { return _slotBricks.size(); }
+    const ospray::vec3i& getCoarseDimensions() const
+    {
+        return _coarseDimensions;
+    }
+    const ospray::uint8* getCoarseVolume() const
+    {
+        return _coarseVolume.data();
+    }
+
+    /**
+       Replaces the loading queue with the given bricks, sorted by decreasing
+       priority, and marks the resident ones as recently used
+    */
+    void prefetch(const std::vector<ospray::uint32>& bricks);
+
+    /**
+       Moves the bricks loaded since the last call into the pool and updates
+       the page table. Must not be called while a frame is being rendered
+       @param dropped Set to true if loaded bricks found no free slot and
+              must be prefetched again
+       @return True if the page table changed
+    */
+    bool update(bool& dropped);
+
+private:
+    enum class BrickState : ospray::uint8
+    {
+        missing,
+        loading,
+        loaded,
+        resident
+    };
+
+    void _buildCoarseVolume();
+    void _load();
+    void _readBrick(const ospray::uint32 brick, ospray::uint8* voxels) const;
+
+    std::string _filename;
+    ospray::vec3i _dimensions;
+    ospray::vec3i _bricks;
+    const ospray::uint8* _voxels{nullptr};
+    size_t _size{0};
+
+    ospray::vec3i _coarseDimensions;
+    std::vector<ospray::uint8> _coarseVolume;
+
+    // Only accessed by the rendering thread
+    std::vector<ospray::uint32> _pageTable;
+    std::vector<ospray::uint8> _pool;
+    std::vector<ospray::uint32> _slotBricks;
+    std::vector<ospray::uint32> _slotFrames;
+    std::list<ospray::uint32> _lru;
+    std::vector<std::list<ospray::uint32>::iterator> _lruPositions;
+    ospray::uint32 _frame{0};
+
+    // Shared with the loader thread
+    std::mutex _mutex;
+    std::condition_variable _condition;
+    std::deque<ospray::uint32> _queue;
+    std::vector<BrickState> _states;
+    std::vector<std::pair<ospray::uint32, std::vector<ospray::uint8>>> _loaded;
+    bool _stopped{false};
+    std::thread _loader;
+};
+} // namespace brayns
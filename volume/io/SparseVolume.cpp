@@ -0,0 +1,206 @@
+/* Copyright (c) 2018, Cyrille Favreau
+ * All rights reserved. Do not distribute without permission.
+ * Responsible Author: Cyrille Favreau <cyrille.favreau@gmail.com>
+ *
+ * This file is part of the reseach Brayns module
+ * <https://github.com/favreau/Brayns-Research-Modules>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "SparseVolume.h"
+#include "BrickStore.h"
+
+#include <ospray/ospcommon/tasking/parallel_for.h>
+
+#include <algorithm>
+#include <cstring>
+
+using namespace ospray;
+
+namespace brayns
+{
+const int SPARSE_NODE_SIZE = 1 << SPARSE_NODE_SIZE_LOG2;
+const size_t SPARSE_NODE_ENTRIES =
+    SPARSE_NODE_SIZE * SPARSE_NODE_SIZE * SPARSE_NODE_SIZE;
+const size_t LEAF_VOXELS = BRICK_SIZE * BRICK_SIZE * BRICK_SIZE;
+
+const uint32 SparseVolume::TILE;
+
+namespace
+{
+// Node of the tree while it is being built, with leaf indices local to the
+// node
+struct NodeBuilder
+{
+    std::vector<uint32> entries;
+    std::vector<uint8> leaves;
+    std::vector<uint8> leafRanges;
+    uint8 minValue{255};
+    uint8 maxValue{0};
+};
+} // namespace
+
+SparseVolume::SparseVolume(const uint8* voxels, const vec3i& dimensions)
+{
+    const int nodeVoxels = BRICK_SIZE * SPARSE_NODE_SIZE;
+    _rootDimensions = (dimensions + vec3i(nodeVoxels - 1)) / nodeVoxels;
+    const size_t nbRootEntries =
+        size_t(_rootDimensions.x) * _rootDimensions.y * _rootDimensions.z;
+
+    // Nodes are built independently, and only the ones holding leaves are
+    // kept. Voxels of partial bricks at the volume boundary are never
+    // sampled, and are set to the first voxel of their brick
+    std::vector<NodeBuilder> builders(nbRootEntries);
+    tasking::parallel_for(nbRootEntries, [&](size_t rootIndex) {
+        NodeBuilder& node = builders[rootIndex];
+        node.entries.resize(SPARSE_NODE_ENTRIES);
+        const vec3i nodeIndex(
+            rootIndex % _rootDimensions.x,
+            (rootIndex / _rootDimensions.x) % _rootDimensions.y,
+            rootIndex / (size_t(_rootDimensions.x) * _rootDimensions.y));
+        std::vector<uint8> leaf(LEAF_VOXELS);
+        for (size_t entry = 0; entry < SPARSE_NODE_ENTRIES; ++entry)
+        {
+            const vec3i brick(entry % SPARSE_NODE_SIZE,
+                              (entry / SPARSE_NODE_SIZE) % SPARSE_NODE_SIZE,
+                              entry / (SPARSE_NODE_SIZE * SPARSE_NODE_SIZE));
+            const vec3i lower =
+                nodeIndex * nodeVoxels + brick * BRICK_SIZE;
+            if (lower.x >= dimensions.x || lower.y >= dimensions.y ||
+                lower.z >= dimensions.z)
+            {
+                node.entries[entry] = TILE;
+                continue;
+            }
+
+            const vec3i upper = min(lower + vec3i(BRICK_SIZE), dimensions);
+            const uint8 first =
+                voxels[lower.x +
+                       dimensions.x *
+                           (lower.y + size_t(dimensions.y) * lower.z)];
+            uint8 minValue = first;
+            uint8 maxValue = first;
+            std::fill(leaf.begin(), leaf.end(), first);
+            for (int z = lower.z; z < upper.z; ++z)
+                for (int y = lower.y; y < upper.y; ++y)
+                {
+                    const uint8* row =
+                        voxels + (size_t(z) * dimensions.y + y) * dimensions.x;
+                    for (int x = lower.x; x < upper.x; ++x)
+                    {
+                        leaf[BrickStore::getMortonCode(x - lower.x,
+                                                       y - lower.y,
+                                                       z - lower.z)] = row[x];
+                        minValue = std::min(minValue, row[x]);
+                        maxValue = std::max(maxValue, row[x]);
+                    }
+                }
+            node.minValue = std::min(node.minValue, minValue);
+            node.maxValue = std::max(node.maxValue, maxValue);
+
+            if (minValue == maxValue)
+            {
+                node.entries[entry] = TILE | minValue;
+                continue;
+            }
+            node.entries[entry] = node.leafRanges.size() / 2;
+            node.leaves.insert(node.leaves.end(), leaf.begin(), leaf.end());
+            node.leafRanges.push_back(minValue);
+            node.leafRanges.push_back(maxValue);
+        }
+    });
+
+    // Nodes without leaves, whose tiles all have the same value, become
+    // tiles of the root
+    _root.resize(nbRootEntries);
+    size_t nbNodes = 0;
+    size_t nbLeaves = 0;
+    for (size_t i = 0; i < nbRootEntries; ++i)
+    {
+        const NodeBuilder& node = builders[i];
+        if (node.leaves.empty() && node.minValue == node.maxValue)
+            _root[i] = TILE | node.minValue;
+        else if (node.leaves.empty() && node.minValue > node.maxValue)
+            _root[i] = TILE;
+        else
+        {
+            _root[i] = nbNodes++;
+            nbLeaves += node.leafRanges.size() / 2;
+        }
+    }
+
+    _nodes.resize(nbNodes * SPARSE_NODE_ENTRIES);
+    _nodeRanges.resize(nbNodes * 2);
+    _leaves.resize(nbLeaves * LEAF_VOXELS);
+    _leafRanges.resize(nbLeaves * 2);
+    size_t leafOffset = 0;
+    for (size_t i = 0; i < nbRootEntries; ++i)
+    {
+        if (_root[i] & TILE)
+            continue;
+        NodeBuilder& node = builders[i];
+        const size_t nodeIndex = _root[i];
+        uint32* entries = _nodes.data() + nodeIndex * SPARSE_NODE_ENTRIES;
+        for (size_t entry = 0; entry < SPARSE_NODE_ENTRIES; ++entry)
+            entries[entry] = node.entries[entry] & TILE
+                                 ? node.entries[entry]
+                                 : node.entries[entry] + leafOffset;
+        _nodeRanges[nodeIndex * 2] = node.minValue;
+        _nodeRanges[nodeIndex * 2 + 1] = node.maxValue;
+        memcpy(_leaves.data() + leafOffset * LEAF_VOXELS, node.leaves.data(),
+               node.leaves.size());
+        memcpy(_leafRanges.data() + leafOffset * 2, node.leafRanges.data(),
+               node.leafRanges.size());
+        leafOffset += node.leafRanges.size() / 2;
+        node = NodeBuilder();
+    }
+
+    _rootVisibility.resize(_root.size(), 1);
+    _nodeVisibility.resize(_nodes.size(), 1);
+}
+
+void SparseVolume::classify(
+    const std::function<bool(uint8, uint8)>& isVisible)
+{
+    for (size_t i = 0; i < _root.size(); ++i)
+    {
+        const uint32 entry = _root[i];
+        _rootVisibility[i] = entry & TILE
+                                 ? isVisible(entry & 0xFF, entry & 0xFF)
+                                 : isVisible(_nodeRanges[entry * 2],
+                                             _nodeRanges[entry * 2 + 1]);
+    }
+
+    tasking::parallel_for(_nodes.size() / SPARSE_NODE_ENTRIES,
+                          [&](size_t node) {
+        const size_t begin = node * SPARSE_NODE_ENTRIES;
+        for (size_t i = begin; i < begin + SPARSE_NODE_ENTRIES; ++i)
+        {
+            const uint32 entry = _nodes[i];
+            _nodeVisibility[i] = entry & TILE
+                                     ? isVisible(entry & 0xFF, entry & 0xFF)
+                                     : isVisible(_leafRanges[entry * 2],
+                                                 _leafRanges[entry * 2 + 1]);
+        }
+    });
+}
+
+size_t SparseVolume::getSize() const
+{
+    return (_root.size() + _nodes.size()) * sizeof(uint32) + _leaves.size() +
+           _nodeRanges.size() + _leafRanges.size() + _rootVisibility.size() +
+           _nodeVisibility.size();
+}
+} // namespace brayns
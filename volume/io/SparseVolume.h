@@ -0,0 +1,92 @@
+/* Copyright (c) 2018, Cyrille Favreau
+ * All rights reserved. Do not distribute without permission.
+ * Responsible Author: Cyrille Favreau <cyrille.favreau@gmail.com>
+ *
+ * This file is part of the reseach Brayns module
+ * <https://github.com/favreau/Brayns-Research-Modules>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include <ospray/SDK/common/Data.h>
+
+#include <functional>
+#include <vector>
+
+namespace brayns
+{
+// Number of leaf bricks of a node along one axis, as a base 2 logarithm.
+// Must match SPARSE_NODE_SIZE_LOG2 in VolumeRenderer.ispc
+const int SPARSE_NODE_SIZE_LOG2 = 4;
+
+/**
+    Sparse volume of 8-bit voxels, as a two-level tree. The root is a dense
+    grid of nodes, nodes are dense grids of 2^SPARSE_NODE_SIZE_LOG2 leaf
+    bricks along each axis, and leaves hold the BRICK_SIZE^3 voxels of a
+    brick in Z-order. Table entries with the TILE bit set are inactive tiles
+    of a constant value, held in their lowest 8 bits, and are not allocated
+*/
+class SparseVolume
+{
+public:
+    static const ospray::uint32 TILE = 0x80000000;
+
+    /**
+       Builds the tree from a dense volume, in x-fastest order. Bricks are
+       turned into tiles when all their voxels have the same value
+    */
+    SparseVolume(const ospray::uint8* voxels,
+                 const ospray::vec3i& dimensions);
+
+    /**
+       Updates the visibility of tiles, leaves and nodes
+       @param isVisible Returns whether any voxel value between the given
+       minimum and maximum is visible
+    */
+    void classify(
+        const std::function<bool(ospray::uint8, ospray::uint8)>& isVisible);
+
+    const ospray::vec3i& getRootDimensions() const { return _rootDimensions; }
+    const ospray::uint32* getRoot() const { return _root.data(); }
+    const ospray::uint32* getNodes() const { return _nodes.data(); }
+    const ospray::uint8* getLeaves() const { return _leaves.data(); }
+    const ospray::uint8* getRootVisibility() const
+    {
+        return _rootVisibility.data();
+    }
+    const ospray::uint8* getNodeVisibility() const
+    {
+        return _nodeVisibility.data();
+    }
+
+    /** Size of the tree, in bytes */
+    size_t getSize() const;
+
+private:
+    ospray::vec3i _rootDimensions;
+    std::vector<ospray::uint32> _root;
+    std::vector<ospray::uint32> _nodes;
+    std::vector<ospray::uint8> _leaves;
+
+    // Minimum and maximum voxel values of nodes and leaves
+    std::vector<ospray::uint8> _nodeRanges;
+    std::vector<ospray::uint8> _leafRanges;
+
+    // Visibility of the root and node entries for the current colormap
+    std::vector<ospray::uint8> _rootVisibility;
+    std::vector<ospray::uint8> _nodeVisibility;
+};
+} // namespace brayns
@@ -21,17 +21,630 @@
 
 #include "VolumeRenderer.h"
 
+#include <plugin/log.h>
+
 // ospray
 #include <ospray/SDK/common/Data.h>
+#include <ospray/SDK/fb/FrameBuffer.h>
 #include <ospray/SDK/lights/Light.h>
+#include <ospray/ospcommon/tasking/parallel_for.h>
 
 // ispc exports
 #include "VolumeRenderer_ispc.h"
 
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
 using namespace ospray;
 
 namespace brayns
 {
+// Number of voxels of a macrocell along one axis. Must match MACROCELL_SIZE
+// in VolumeRenderer.ispc
+const int MACROCELL_SIZE = 8;
+
+// Maximum number of levels of the mip pyramid, including the full
+// resolution. Must match MAX_MIP_LEVELS in VolumeRenderer.ispc
+const int32 MAX_MIP_LEVELS = 8;
+
+// Number of voxels processed by each task when quantizing volumes
+const size_t QUANTIZATION_CHUNK_SIZE = 1 << 20;
+
+// Number of bricks along one axis of the groups tested against the camera
+// frustum when prefetching streamed bricks
+const int PREFETCH_GROUP_SIZE = 8;
+
+// Step of ray marched volume shadows, along which colormap opacities are
+// accumulated. Must match EPSILON in VolumeRenderer.ispc
+const float SHADOW_STEP = 0.001f;
+
+namespace
+{
+// Octahedral encoding of a normal on two bytes. Codes range from 1 to 255
+// so that (0, 0) can encode a null gradient
+void _encodeNormal(const vec3f& normal, uint8* code)
+{
+    const float sum =
+        std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+    if (sum < 1e-6f)
+    {
+        code[0] = code[1] = 0;
+        return;
+    }
+
+    float u = normal.x / sum;
+    float v = normal.y / sum;
+    if (normal.z < 0.f)
+    {
+        const float x = u;
+        u = (1.f - std::abs(v)) * (x >= 0.f ? 1.f : -1.f);
+        v = (1.f - std::abs(x)) * (v >= 0.f ? 1.f : -1.f);
+    }
+    code[0] = 1 + uint8(std::round((u * 0.5f + 0.5f) * 254.f));
+    code[1] = 1 + uint8(std::round((v * 0.5f + 0.5f) * 254.f));
+}
+
+// Quantizes voxels into 8 bits, with the scale and offset mapping the range
+// of their values
+template <typename T>
+void _quantize(const T* voxels, const size_t nbVoxels,
+               std::vector<uint8>& quantized, float& scale, float& offset)
+{
+    const size_t nbChunks =
+        (nbVoxels + QUANTIZATION_CHUNK_SIZE - 1) / QUANTIZATION_CHUNK_SIZE;
+    std::vector<float> minValues(nbChunks, std::numeric_limits<float>::max());
+    std::vector<float> maxValues(nbChunks, -std::numeric_limits<float>::max());
+    tasking::parallel_for(nbChunks, [&](size_t chunk) {
+        const size_t end =
+            std::min(nbVoxels, (chunk + 1) * QUANTIZATION_CHUNK_SIZE);
+        for (size_t i = chunk * QUANTIZATION_CHUNK_SIZE; i < end; ++i)
+        {
+            minValues[chunk] = std::min(minValues[chunk], float(voxels[i]));
+            maxValues[chunk] = std::max(maxValues[chunk], float(voxels[i]));
+        }
+    });
+    const float minValue =
+        *std::min_element(minValues.begin(), minValues.end());
+    const float maxValue =
+        *std::max_element(maxValues.begin(), maxValues.end());
+    offset = minValue;
+    scale = maxValue > minValue ? (maxValue - minValue) / 255.f : 1.f;
+
+    quantized.resize(nbVoxels);
+    tasking::parallel_for(nbChunks, [&](size_t chunk) {
+        const size_t end =
+            std::min(nbVoxels, (chunk + 1) * QUANTIZATION_CHUNK_SIZE);
+        for (size_t i = chunk * QUANTIZATION_CHUNK_SIZE; i < end; ++i)
+            quantized[i] = uint8(std::max(
+                0.f,
+                std::min(255.f, std::round((voxels[i] - offset) / scale))));
+    });
+}
+
+// Halves the resolution of a volume, averaging the voxels of each 2^3 block
+std::vector<uint8> _downsample(const uint8* voxels, const vec3i& dimensions)
+{
+    const vec3i halved = (dimensions + vec3i(1)) / 2;
+    const size_t width = dimensions.x;
+    const size_t sliceSize = width * dimensions.y;
+    std::vector<uint8> result(size_t(halved.x) * halved.y * halved.z);
+    tasking::parallel_for(halved.z, [&](int z) {
+        for (int y = 0; y < halved.y; ++y)
+            for (int x = 0; x < halved.x; ++x)
+            {
+                const vec3i lower = vec3i(x, y, z) * 2;
+                const vec3i upper = min(lower + vec3i(2), dimensions);
+                uint32 sum = 0;
+                uint32 count = 0;
+                for (int k = lower.z; k < upper.z; ++k)
+                    for (int j = lower.y; j < upper.y; ++j)
+                        for (int i = lower.x; i < upper.x; ++i)
+                        {
+                            sum += voxels[k * sliceSize + j * width + i];
+                            ++count;
+                        }
+                result[x + halved.x * (y + size_t(halved.y) * z)] =
+                    sum / count;
+            }
+    });
+    return result;
+}
+} // namespace
+
+void VolumeRenderer::_quantizeVolume()
+{
+    _quantizedSourceData = _sourceVolumeData;
+    _quantizedVoxelType = _voxelType;
+    _quantizedVolumeDimensions = _volumeDimensions;
+    _quantizedVolume.clear();
+    _quantizedVolumeData = nullptr;
+    _voxelScale = 1.f;
+    _voxelOffset = 0.f;
+    if (_voxelType == VoxelType::uint8 || !_sourceVolumeData ||
+        reduce_min(_volumeDimensions) <= 0)
+        return;
+
+    const size_t nbVoxels = size_t(_volumeDimensions.x) *
+                            _volumeDimensions.y * _volumeDimensions.z;
+    const size_t voxelSize =
+        _voxelType == VoxelType::uint16 ? sizeof(uint16) : sizeof(float);
+    if (_sourceVolumeData->numBytes < nbVoxels * voxelSize)
+    {
+        PLUGIN_ERROR << "Volume data of " << _sourceVolumeData->numBytes
+                     << " bytes is too small for " << nbVoxels << " voxels of "
+                     << voxelSize << " bytes" << std::endl;
+        return;
+    }
+
+    if (_voxelType == VoxelType::uint16)
+        _quantize((const uint16*)_sourceVolumeData->data, nbVoxels,
+                  _quantizedVolume, _voxelScale, _voxelOffset);
+    else
+        _quantize((const float*)_sourceVolumeData->data, nbVoxels,
+                  _quantizedVolume, _voxelScale, _voxelOffset);
+    _quantizedVolumeData = new ospray::Data(nbVoxels, OSP_UCHAR,
+                                            _quantizedVolume.data(),
+                                            OSP_DATA_SHARED_BUFFER);
+}
+
+bool VolumeRenderer::_isSampledFromSource() const
+{
+    return _voxelType != VoxelType::uint8 && !_volumeQuantization &&
+           !_brickStore && _quantizedVolumeData;
+}
+
+void VolumeRenderer::_buildBricks()
+{
+    _brickVolumeData = _volumeData;
+    _brickVolumeDimensions = _volumeDimensions;
+    _bricks.clear();
+    _brickTable.clear();
+    _brickDimensions = vec3i(0);
+    if (!_bricking || _brickStore || _sparseVolume || _isSampledFromSource() ||
+        !_volumeData || reduce_min(_volumeDimensions) <= 0)
+        return;
+
+    _brickDimensions = (_volumeDimensions + vec3i(BRICK_SIZE - 1)) / BRICK_SIZE;
+    const vec3i& bricks = _brickDimensions;
+    const vec3i& dimensions = _volumeDimensions;
+    const size_t brickSize = BRICK_SIZE * BRICK_SIZE * BRICK_SIZE;
+
+    // Voxels of partial bricks at the volume boundary are never sampled
+    const size_t nbBricks = size_t(bricks.x) * bricks.y * bricks.z;
+    _bricks.resize(nbBricks * brickSize, 0);
+
+    // Resident bricks are simply mapped to themselves
+    _brickTable.resize(nbBricks);
+    for (size_t i = 0; i < nbBricks; ++i)
+        _brickTable[i] = i;
+
+    const uint8* voxels = (const uint8*)_volumeData->data;
+    tasking::parallel_for(bricks.z, [&](int bz) {
+        for (int by = 0; by < bricks.y; ++by)
+            for (int bx = 0; bx < bricks.x; ++bx)
+            {
+                const size_t brick =
+                    bx + bricks.x * (by + size_t(bricks.y) * bz);
+                uint8* brickVoxels = _bricks.data() + brick * brickSize;
+                const vec3i lower = vec3i(bx, by, bz) * BRICK_SIZE;
+                const vec3i upper = min(lower + vec3i(BRICK_SIZE), dimensions);
+                for (int z = lower.z; z < upper.z; ++z)
+                    for (int y = lower.y; y < upper.y; ++y)
+                    {
+                        const uint8* row =
+                            voxels +
+                            (size_t(z) * dimensions.y + y) * dimensions.x;
+                        for (int x = lower.x; x < upper.x; ++x)
+                            brickVoxels[BrickStore::getMortonCode(
+                                x - lower.x, y - lower.y, z - lower.z)] =
+                                row[x];
+                    }
+            }
+    });
+}
+
+void VolumeRenderer::_buildMipLevels()
+{
+    _mipVolumeData = _volumeData;
+    _mipVolumeDimensions = _volumeDimensions;
+    _mipVolumeLevels = _volumeMipLevels;
+    _mipVolumes.clear();
+    _mipLevels.clear();
+    _mipDimensions.clear();
+    if (_volumeMipLevels <= 1 || _sparseVolume || !_volumeData ||
+        reduce_min(_volumeDimensions) <= 0)
+        return;
+
+    // Level 0 is sampled from the volume itself
+    _mipLevels.push_back(nullptr);
+    _mipDimensions.push_back(_volumeDimensions);
+    const int32 nbLevels = std::min(_volumeMipLevels, MAX_MIP_LEVELS);
+    _mipVolumes.resize(nbLevels);
+    for (int32 level = 1;
+         level < nbLevels && reduce_max(_mipDimensions.back()) > 1; ++level)
+    {
+        const vec3i& source = _mipDimensions.back();
+        const vec3i dimensions = (source + vec3i(1)) / 2;
+
+        // Streamed volumes only keep the levels that are not larger than
+        // their resident coarse copy, which is itself one of the levels
+        uint8* voxels = nullptr;
+        if (_brickStore && (1 << level) == COARSE_FACTOR)
+            voxels = const_cast<uint8*>(_brickStore->getCoarseVolume());
+        else if (!_brickStore || (1 << level) > COARSE_FACTOR)
+        {
+            _mipVolumes[level] =
+                _downsample(level == 1 ? (const uint8*)_volumeData->data
+                                       : _mipLevels.back(),
+                            source);
+            voxels = _mipVolumes[level].data();
+        }
+        _mipLevels.push_back(voxels);
+        _mipDimensions.push_back(dimensions);
+    }
+}
+
+void VolumeRenderer::_buildGradients()
+{
+    _gradientVolumeData = _volumeData;
+    _gradientVolumeDimensions = _volumeDimensions;
+    _gradientVolumeElementSpacing = _volumeElementSpacing;
+    _gradients.clear();
+
+    // Gradients take twice the size of the volume, and are not built for
+    // streamed or sparse volumes
+    if (!_gradientVolume || _brickStore || _sparseVolume || !_volumeData ||
+        reduce_min(_volumeDimensions) <= 0)
+        return;
+
+    const vec3i& dimensions = _volumeDimensions;
+    const uint8* voxels = (const uint8*)_volumeData->data;
+    _gradients.resize(size_t(dimensions.x) * dimensions.y * dimensions.z * 2);
+
+    // Normals point towards lower voxel values. Differences are clamped at
+    // the volume boundaries
+    const vec3f scale = vec3f(-0.5f) / _volumeElementSpacing;
+    const size_t width = dimensions.x;
+    const size_t sliceSize = width * dimensions.y;
+    tasking::parallel_for(dimensions.z, [&](int z) {
+        const size_t z0 = std::max(0, z - 1) * sliceSize;
+        const size_t z1 = std::min(dimensions.z - 1, z + 1) * sliceSize;
+        for (int y = 0; y < dimensions.y; ++y)
+        {
+            const size_t y0 = std::max(0, y - 1) * width;
+            const size_t y1 = std::min(dimensions.y - 1, y + 1) * width;
+            const size_t row = z * sliceSize + y * width;
+            for (int x = 0; x < dimensions.x; ++x)
+            {
+                const size_t x0 = std::max(0, x - 1);
+                const size_t x1 = std::min(dimensions.x - 1, x + 1);
+                const vec3f gradient(
+                    float(voxels[row + x1]) - voxels[row + x0],
+                    float(voxels[z * sliceSize + y1 + x]) -
+                        voxels[z * sliceSize + y0 + x],
+                    float(voxels[z1 + y * width + x]) -
+                        voxels[z0 + y * width + x]);
+                _encodeNormal(gradient * scale, &_gradients[(row + x) * 2]);
+            }
+        }
+    });
+}
+
+void VolumeRenderer::_buildMacrocells()
+{
+    _macrocellVolumeData = _volumeData;
+    _macrocellVolumeDimensions = _volumeDimensions;
+    _macrocellRanges.clear();
+    _macrocellDimensions = vec3i(0);
+    if (_sparseVolume || !_volumeData || reduce_min(_volumeDimensions) <= 0)
+        return;
+
+    _macrocellDimensions =
+        (_volumeDimensions + vec3i(MACROCELL_SIZE - 1)) / MACROCELL_SIZE;
+    const vec3i& cells = _macrocellDimensions;
+    const vec3i& dimensions = _volumeDimensions;
+    _macrocellRanges.resize(size_t(cells.x) * cells.y * cells.z * 2);
+
+    const uint8* voxels = (const uint8*)_volumeData->data;
+    tasking::parallel_for(cells.z, [&](int cz) {
+        for (int cy = 0; cy < cells.y; ++cy)
+            for (int cx = 0; cx < cells.x; ++cx)
+            {
+                const vec3i lower = vec3i(cx, cy, cz) * MACROCELL_SIZE;
+                const vec3i upper =
+                    min(lower + vec3i(MACROCELL_SIZE), dimensions);
+                uint8 minValue = 255;
+                uint8 maxValue = 0;
+                for (int z = lower.z; z < upper.z; ++z)
+                    for (int y = lower.y; y < upper.y; ++y)
+                    {
+                        const uint8* row =
+                            voxels +
+                            (size_t(z) * dimensions.y + y) * dimensions.x;
+                        for (int x = lower.x; x < upper.x; ++x)
+                        {
+                            minValue = std::min(minValue, row[x]);
+                            maxValue = std::max(maxValue, row[x]);
+                        }
+                    }
+                const size_t index = cx + cells.x * (cy + size_t(cells.y) * cz);
+                _macrocellRanges[index * 2] = minValue;
+                _macrocellRanges[index * 2 + 1] = maxValue;
+            }
+    });
+}
+
+void VolumeRenderer::_classifyMacrocells()
+{
+    _macrocellTransferFunctionMinValue = _transferFunctionMinValue;
+    _macrocellTransferFunctionRange = _transferFunctionRange;
+    _macrocellTransferFunctionSize = _transferFunctionSize;
+    _macrocells.clear();
+
+    const size_t nbMacrocells = _macrocellRanges.size() / 2;
+    if (nbMacrocells == 0 || _transferFunctionSize <= 0 ||
+        _transferFunctionRange == 0.f)
+        return;
+
+    const std::vector<uint32> visibleEntries = _countVisibleEntries();
+    _macrocells.resize(nbMacrocells);
+    for (size_t i = 0; i < nbMacrocells; ++i)
+        _macrocells[i] = _isVisible(visibleEntries, _macrocellRanges[i * 2],
+                                    _macrocellRanges[i * 2 + 1]);
+}
+
+void VolumeRenderer::_buildSparseVolume()
+{
+    _sparseVolumeData = _volumeData;
+    _sparseVolumeDimensions = _volumeDimensions;
+    _sparseVolume.reset();
+
+    // Dense acceleration structures are rebuilt, or dropped when the volume
+    // is sparse
+    _brickVolumeData = nullptr;
+    _gradientVolumeData = nullptr;
+    _mipVolumeData = nullptr;
+    _macrocellVolumeData = nullptr;
+
+    if (!_sparse || !_volumeData || reduce_min(_volumeDimensions) <= 0)
+        return;
+    _sparseVolume.reset(new SparseVolume((const uint8*)_volumeData->data,
+                                         _volumeDimensions));
+}
+
+void VolumeRenderer::_classifySparseVolume()
+{
+    if (!_sparseVolume)
+        return;
+    if (_transferFunctionSize <= 0 || _transferFunctionRange == 0.f)
+    {
+        _sparseVolume->classify([](uint8, uint8) { return true; });
+        return;
+    }
+    const std::vector<uint32> visibleEntries = _countVisibleEntries();
+    _sparseVolume->classify(
+        [this, &visibleEntries](const uint8 minValue, const uint8 maxValue) {
+            return _isVisible(visibleEntries, minValue, maxValue);
+        });
+}
+
+std::vector<uint32> VolumeRenderer::_countVisibleEntries() const
+{
+    // Number of visible colormap entries up to each entry, so that the
+    // visibility of a range of values is a single subtraction. Entries
+    // missing from the colormap data are considered visible
+    const int32 size = _transferFunctionSize;
+    std::vector<uint32> visibleEntries(size + 1, 0);
+    for (int32 i = 0; i < size; ++i)
+        visibleEntries[i + 1] =
+            visibleEntries[i] + (size_t(i) >= _macrocellOpacities.size() ||
+                                         _macrocellOpacities[i] > 0.f
+                                     ? 1
+                                     : 0);
+    return visibleEntries;
+}
+
+bool VolumeRenderer::_isVisible(const std::vector<uint32>& visibleEntries,
+                                const uint8 minValue,
+                                const uint8 maxValue) const
+{
+    int32 first = _getColorMapIndex(minValue);
+    int32 last = _getColorMapIndex(maxValue);
+    if (first > last)
+        std::swap(first, last);
+    return visibleEntries[last + 1] > visibleEntries[first];
+}
+
+int32 VolumeRenderer::_getColorMapIndex(const float value) const
+{
+    // Colormap entry of an 8-bit voxel, as looked up by the ispc code
+    const float normalizedValue = std::max(
+        0.f, std::min(1.f, (value * _voxelScale + _voxelOffset -
+                            _transferFunctionMinValue) /
+                               _transferFunctionRange));
+    return std::min(_transferFunctionSize - 1,
+                    int32(_transferFunctionSize * normalizedValue));
+}
+
+void VolumeRenderer::_buildShadowVolumes(const std::vector<vec3f>& directions)
+{
+    _shadowVolumes.clear();
+    _shadowVolumeDimensions = vec3i(0);
+    _shadowVolumeCellSize = 1;
+    const vec3i& dimensions = _volumeDimensions;
+    if (directions.empty() || _shadowVolumeResolution <= 0 || !_volumeData ||
+        reduce_min(dimensions) <= 0 || _transferFunctionSize <= 0 ||
+        _transferFunctionRange == 0.f)
+        return;
+
+    // Opacity of each voxel value
+    std::vector<float> opacities(256, 0.f);
+    for (size_t value = 0; value < opacities.size(); ++value)
+    {
+        const size_t index = _getColorMapIndex(value);
+        if (index < _macrocellOpacities.size())
+            opacities[value] = _macrocellOpacities[index];
+    }
+
+    const int32 cellSize =
+        std::max(1, (reduce_max(dimensions) + _shadowVolumeResolution - 1) /
+                        _shadowVolumeResolution);
+    const vec3i cells = (dimensions + vec3i(cellSize - 1)) / cellSize;
+    const size_t nbCells = size_t(cells.x) * cells.y * cells.z;
+    _shadowVolumeCellSize = cellSize;
+    _shadowVolumeDimensions = cells;
+    _shadowVolumes.resize(nbCells * directions.size());
+
+    const uint8* voxels = (const uint8*)_volumeData->data;
+    const auto getOpacity = [&](const vec3f& point) {
+        const vec3i voxel(std::floor(point.x), std::floor(point.y),
+                          std::floor(point.z));
+        if (voxel.x < 0 || voxel.y < 0 || voxel.z < 0 ||
+            voxel.x >= dimensions.x || voxel.y >= dimensions.y ||
+            voxel.z >= dimensions.z)
+            return 0.f;
+        const size_t index =
+            voxel.x + dimensions.x * (voxel.y + size_t(dimensions.y) * voxel.z);
+        return opacities[voxels[index]];
+    };
+
+    for (size_t light = 0; light < directions.size(); ++light)
+    {
+        float* volume = _shadowVolumes.data() + light * nbCells;
+        const vec3f direction =
+            normalize(directions[light] / _volumeElementSpacing);
+
+        // Cells are swept slice by slice along the major axis of the light
+        // direction, starting from the light. The shadow intensity of a cell
+        // is the one found where the light ray crosses the previous slice,
+        // plus the opacity accumulated in between
+        int axis = 0;
+        for (int i = 1; i < 3; ++i)
+            if (std::abs(direction[i]) > std::abs(direction[axis]))
+                axis = i;
+        const int axis1 = (axis + 1) % 3;
+        const int axis2 = (axis + 2) % 3;
+        const int towardsLight = direction[axis] > 0.f ? 1 : -1;
+        const float distance = cellSize / std::abs(direction[axis]);
+        const int nbSteps = std::max(1, int(std::ceil(distance)));
+        const float step = distance / nbSteps;
+
+        const auto getCellIndex = [&](const vec3i& cell) {
+            return cell.x + cells.x * (cell.y + size_t(cells.y) * cell.z);
+        };
+
+        for (int slice = 0; slice < cells[axis]; ++slice)
+        {
+            const int k = towardsLight > 0 ? cells[axis] - 1 - slice : slice;
+            const int previous = k + towardsLight;
+            tasking::parallel_for(cells[axis1], [&](int j) {
+                for (int i = 0; i < cells[axis2]; ++i)
+                {
+                    vec3i cell;
+                    cell[axis] = k;
+                    cell[axis1] = j;
+                    cell[axis2] = i;
+                    const vec3f point =
+                        (vec3f(cell) + vec3f(0.5f)) * float(cellSize);
+
+                    // Intensity where the light ray crosses the previous
+                    // slice, bilinearly interpolated. Light enters the
+                    // volume without any shadow
+                    float intensity = 0.f;
+                    const vec3f upstream =
+                        point / float(cellSize) +
+                        direction * (distance / cellSize) - vec3f(0.5f);
+                    if (previous >= 0 && previous < cells[axis] &&
+                        upstream[axis1] >= -0.5f &&
+                        upstream[axis1] <= cells[axis1] - 0.5f &&
+                        upstream[axis2] >= -0.5f &&
+                        upstream[axis2] <= cells[axis2] - 0.5f)
+                    {
+                        const float u = std::max(
+                            0.f,
+                            std::min(float(cells[axis1] - 1), upstream[axis1]));
+                        const float v = std::max(
+                            0.f,
+                            std::min(float(cells[axis2] - 1), upstream[axis2]));
+                        const int u0 = u;
+                        const int v0 = v;
+                        const int u1 = std::min(u0 + 1, cells[axis1] - 1);
+                        const int v1 = std::min(v0 + 1, cells[axis2] - 1);
+                        const float fu = u - u0;
+                        const float fv = v - v0;
+                        vec3i c;
+                        c[axis] = previous;
+                        const auto value = [&](const int cu, const int cv) {
+                            c[axis1] = cu;
+                            c[axis2] = cv;
+                            return volume[getCellIndex(c)];
+                        };
+                        intensity =
+                            (1.f - fv) * ((1.f - fu) * value(u0, v0) +
+                                          fu * value(u1, v0)) +
+                            fv * ((1.f - fu) * value(u0, v1) +
+                                  fu * value(u1, v1));
+                    }
+
+                    for (int n = 0; n < nbSteps && intensity < 1.f; ++n)
+                    {
+                        const vec3f sample =
+                            point + direction * (step * (n + 0.5f));
+                        intensity += getOpacity(sample) * step / SHADOW_STEP;
+                    }
+                    volume[getCellIndex(cell)] = std::min(1.f, intensity);
+                }
+            });
+        }
+    }
+}
+
+void VolumeRenderer::_buildPreIntegrationTable()
+{
+    _preIntegrationTable.clear();
+    const size_t size = _transferFunctionSize;
+    if (_preIntegratedColorMap.size() != size * 7 || size == 0)
+        return;
+
+    // Prefix sums of opacities, opacity weighted colors and emissions, so
+    // that averages over any range of entries are a single subtraction
+    const float* diffuse = _preIntegratedColorMap.data();
+    const float* emission = diffuse + size * 4;
+    std::vector<float> opacities(size + 1, 0.f);
+    std::vector<vec3f> colors(size + 1, vec3f(0.f));
+    std::vector<vec3f> emissions(size + 1, vec3f(0.f));
+    for (size_t i = 0; i < size; ++i)
+    {
+        const float opacity = diffuse[i * 4 + 3];
+        opacities[i + 1] = opacities[i] + opacity;
+        colors[i + 1] = colors[i] + vec3f(diffuse[i * 4], diffuse[i * 4 + 1],
+                                          diffuse[i * 4 + 2]) *
+                                        opacity;
+        emissions[i + 1] = emissions[i] + vec3f(emission[i * 3],
+                                                emission[i * 3 + 1],
+                                                emission[i * 3 + 2]);
+    }
+
+    // Entry (front, back) holds the average of the colormap between both
+    // values, assuming a linear variation of the value along the segment
+    _preIntegrationTable.resize(size * size);
+    for (size_t front = 0; front < size; ++front)
+        for (size_t back = 0; back < size; ++back)
+        {
+            const size_t first = std::min(front, back);
+            const size_t last = std::max(front, back) + 1;
+            const float count = last - first;
+            const float opacity = opacities[last] - opacities[first];
+            const vec3f color =
+                (opacity > 0.f ? (colors[last] - colors[first]) / opacity
+                               : vec3f(0.f)) +
+                (emissions[last] - emissions[first]) / count;
+            _preIntegrationTable[front * size + back] =
+                vec4f(color.x, color.y, color.z, opacity / count);
+        }
+}
+
 void VolumeRenderer::commit()
 {
     Renderer::commit();
@@ -54,7 +667,6 @@ void VolumeRenderer::commit()
     _shadingEnabled = bool(getParam1i("shadingEnabled", 1));
     _randomNumber = getParam1i("randomNumber", 0);
     _timestamp = getParam1f("timestamp", 0.f);
-    _spp = getParam1i("spp", 1);
     _electronShadingEnabled = bool(getParam1i("electronShading", 0));
 
     // Those materials are used for simulation mapping only
@@ -66,15 +678,68 @@ void VolumeRenderer::commit()
                 ((ospray::Material**)_materialData->data)[i]->getIE());
     _materialPtr = _materialArray.empty() ? nullptr : &_materialArray[0];
 
-    // Volume
-    _volumeData = getParamData("volumeData");
+    // Volume. Volumes larger than memory are streamed from a raw file
+    // through a cache of bricks
     _volumeDimensions = getParam3i("volumeDimensions", ospray::vec3i(0));
+    const std::string volumeFilename = getParamString("volumeFilename", "");
+    const size_t volumeCacheSize =
+        size_t(getParam1i("volumeCacheSize", 1024)) * 1024 * 1024;
+    if (volumeFilename.empty())
+    {
+        _brickStoreData = nullptr;
+        _brickStore.reset();
+    }
+    else if (!_brickStore || _brickStore->getFilename() != volumeFilename ||
+             _brickStore->getDimensions() != _volumeDimensions ||
+             volumeCacheSize != _volumeCacheSize)
+    {
+        _brickStoreData = nullptr;
+        _brickStore.reset();
+        _brickStore.reset(new BrickStore(volumeFilename, _volumeDimensions,
+                                         volumeCacheSize));
+        _brickStoreData =
+            new ospray::Data(size_t(_volumeDimensions.x) *
+                                 _volumeDimensions.y * _volumeDimensions.z,
+                             OSP_UCHAR,
+                             const_cast<uint8*>(_brickStore->getVoxels()),
+                             OSP_DATA_SHARED_BUFFER);
+        _prefetchKey.clear();
+    }
+    _volumeCacheSize = volumeCacheSize;
+
+    // Voxel type. Volumes of other types than 8-bit are quantized
+    const std::string voxelType = getParamString("volumeDataType", "uint8");
+    _voxelType = voxelType == "uint16"
+                     ? VoxelType::uint16
+                     : voxelType == "float" ? VoxelType::float32
+                                            : VoxelType::uint8;
+    _volumeQuantization = bool(getParam1i("volumeQuantization", 1));
+    _sourceVolumeData = getParamData("volumeData");
+    if (_sourceVolumeData.ptr != _quantizedSourceData.ptr ||
+        _voxelType != _quantizedVoxelType ||
+        _volumeDimensions != _quantizedVolumeDimensions)
+        _quantizeVolume();
+
+    // Typed volumes that could not be quantized are not rendered
+    if (_brickStore)
+        _volumeData = _brickStoreData;
+    else if (_quantizedVolumeData)
+        _volumeData = _quantizedVolumeData;
+    else if (_voxelType == VoxelType::uint8)
+        _volumeData = _sourceVolumeData;
+    else
+        _volumeData = nullptr;
     _volumeElementSpacing =
         getParam3f("volumeElementSpacing", ospray::vec3f(1.f));
     _volumeOffset = getParam3f("volumeOffset", ospray::vec3f(0.f));
     _volumeEpsilon = getParam1f("volumeEpsilon", 1.f);
     _volumeSamplesPerRay = getParam1i("volumeSamplesPerRay", 32);
 
+    // Sampling. The base step of the unshaded mode is divided by the quality,
+    // and adaptive sampling takes larger steps in low opacity regions
+    _samplingQuality = getParam1f("samplingQuality", 1.f);
+    _adaptiveSampling = bool(getParam1i("adaptiveSampling", 0));
+
     // Transfer function
     _transferFunctionDiffuseData = getParamData("transferFunctionDiffuseData");
     _transferFunctionEmissionData =
@@ -84,10 +749,66 @@ void VolumeRenderer::commit()
     _transferFunctionRange = getParam1f("transferFunctionRange", 0.f);
     _threshold = getParam1f("threshold", _transferFunctionMinValue);
 
+    // Sparse volume, replacing the dense acceleration structures
+    _sparse = bool(getParam1i("volumeSparse", 0));
+    if (_volumeData.ptr != _sparseVolumeData.ptr ||
+        _volumeDimensions != _sparseVolumeDimensions ||
+        _sparse != bool(_sparseVolume))
+        _buildSparseVolume();
+
+    // Bricked copy of the volume, optional since the flat volume is kept
+    _bricking = bool(getParam1i("volumeBricking", 0));
+    if (_volumeData.ptr != _brickVolumeData.ptr ||
+        _volumeDimensions != _brickVolumeDimensions ||
+        (_bricking && !_isSampledFromSource()) != !_bricks.empty())
+        _buildBricks();
+
+    // Precomputed normals, optional since they take 2 bytes per voxel
+    _gradientVolume = bool(getParam1i("gradientVolume", 0));
+    if (_volumeData.ptr != _gradientVolumeData.ptr ||
+        _volumeDimensions != _gradientVolumeDimensions ||
+        _volumeElementSpacing != _gradientVolumeElementSpacing ||
+        _gradientVolume != !_gradients.empty())
+        _buildGradients();
+
+    // Mip pyramid
+    _volumeMipLevels = getParam1i("volumeMipLevels", 6);
+    if (_volumeData.ptr != _mipVolumeData.ptr ||
+        _volumeDimensions != _mipVolumeDimensions ||
+        _volumeMipLevels != _mipVolumeLevels)
+        _buildMipLevels();
+
+    // Macrocell value ranges only depend on the volume, and their visibility
+    // is re-classified whenever the transfer function changes
+    bool classify = false;
+    if (_volumeData.ptr != _macrocellVolumeData.ptr ||
+        _volumeDimensions != _macrocellVolumeDimensions)
+    {
+        _buildMacrocells();
+        classify = true;
+    }
+
+    std::vector<float> opacities;
+    if (_transferFunctionDiffuseData)
+    {
+        const vec4f* colors = (const vec4f*)_transferFunctionDiffuseData->data;
+        for (size_t i = 0; i < _transferFunctionDiffuseData->size(); ++i)
+            opacities.push_back(colors[i].w);
+    }
+    if (classify || opacities != _macrocellOpacities ||
+        _transferFunctionMinValue != _macrocellTransferFunctionMinValue ||
+        _transferFunctionRange != _macrocellTransferFunctionRange ||
+        _transferFunctionSize != _macrocellTransferFunctionSize)
+    {
+        _macrocellOpacities = opacities;
+        _classifyMacrocells();
+        _classifySparseVolume();
+    }
+
     ispc::VolumeRenderer_set(
         getIE(), (ispc::vec3f&)_bgColor, _shadows, _softShadows,
         _ambientOcclusionStrength, _ambientOcclusionDistance, _shadingEnabled,
-        _randomNumber, _timestamp, _spp, _electronShadingEnabled, _lightPtr,
+        _randomNumber, _timestamp, _electronShadingEnabled, _lightPtr,
         _lightArray.size(), _materialPtr, _materialArray.size(),
         _volumeData ? (uint8*)_volumeData->data : NULL,
         (ispc::vec3i&)_volumeDimensions, (ispc::vec3f&)_volumeElementSpacing,
@@ -100,6 +821,260 @@ void VolumeRenderer::commit()
             : NULL,
         _transferFunctionSize, _transferFunctionMinValue,
         _transferFunctionRange, _threshold);
+
+    if (_brickStore)
+        ispc::VolumeRenderer_setBricks(
+            getIE(), const_cast<uint8*>(_brickStore->getPool()),
+            const_cast<uint32*>(_brickStore->getPageTable()),
+            (ispc::vec3i&)_brickStore->getBrickDimensions(),
+            const_cast<uint8*>(_brickStore->getCoarseVolume()),
+            (ispc::vec3i&)_brickStore->getCoarseDimensions());
+    else
+    {
+        const vec3i coarseDimensions(0);
+        ispc::VolumeRenderer_setBricks(
+            getIE(), _bricks.empty() ? nullptr : _bricks.data(),
+            _brickTable.empty() ? nullptr : _brickTable.data(),
+            (ispc::vec3i&)_brickDimensions, nullptr,
+            (ispc::vec3i&)coarseDimensions);
+    }
+
+    if (_sparseVolume)
+        ispc::VolumeRenderer_setSparseVolume(
+            getIE(), const_cast<uint32*>(_sparseVolume->getRoot()),
+            (ispc::vec3i&)_sparseVolume->getRootDimensions(),
+            const_cast<uint32*>(_sparseVolume->getNodes()),
+            const_cast<uint8*>(_sparseVolume->getLeaves()),
+            const_cast<uint8*>(_sparseVolume->getRootVisibility()),
+            const_cast<uint8*>(_sparseVolume->getNodeVisibility()));
+    else
+    {
+        const vec3i rootDimensions(0);
+        ispc::VolumeRenderer_setSparseVolume(getIE(), nullptr,
+                                             (ispc::vec3i&)rootDimensions,
+                                             nullptr, nullptr, nullptr,
+                                             nullptr);
+    }
+
+    // Sampling kernel of the voxel type
+    ispc::VolumeRenderer_setVoxelType(
+        getIE(), int32(_voxelType),
+        _isSampledFromSource() ? (uint8*)_sourceVolumeData->data : nullptr,
+        _voxelScale, _voxelOffset);
+
+    ispc::VolumeRenderer_setMipLevels(
+        getIE(), _mipLevels.empty() ? nullptr : _mipLevels.data(),
+        _mipDimensions.empty() ? nullptr
+                               : (ispc::vec3i*)_mipDimensions.data(),
+        _mipLevels.size());
+
+    ispc::VolumeRenderer_setGradients(
+        getIE(), _gradients.empty() ? nullptr : _gradients.data());
+
+    // Shadow volumes. They are swept along a single direction per light,
+    // and are only built when every light has the same direction from the
+    // corners of the volume. Positional lights fall back to ray marched
+    // shadows
+    _shadowVolumeResolution = getParam1i("shadowVolumeResolution", 128);
+    std::vector<vec3f> lightDirections;
+    if (_shadows > 0.f && _softShadows == 0.f && _shadowVolumeResolution > 0)
+    {
+        const vec3f size = vec3f(_volumeDimensions) * _volumeElementSpacing;
+        bool directional = true;
+        for (size_t i = 0; directional && i < _lightArray.size(); ++i)
+        {
+            vec3f directions[8];
+            for (int corner = 0; corner < 8; ++corner)
+            {
+                const vec3f point =
+                    _volumeOffset + size * vec3f(corner & 1 ? 1.f : 0.f,
+                                                 corner & 2 ? 1.f : 0.f,
+                                                 corner & 4 ? 1.f : 0.f);
+                ispc::VolumeRenderer_getLightDirection(
+                    getIE(), i, (ispc::vec3f&)point,
+                    (ispc::vec3f&)directions[corner]);
+                if (length(directions[corner] - directions[0]) > 1e-4f)
+                    directional = false;
+            }
+            lightDirections.push_back(directions[0]);
+        }
+        if (!directional)
+            lightDirections.clear();
+    }
+    std::vector<float> shadowVolumeKey{
+        _transferFunctionMinValue, _transferFunctionRange,
+        float(_transferFunctionSize), float(_shadowVolumeResolution),
+        float(_volumeDimensions.x), float(_volumeDimensions.y),
+        float(_volumeDimensions.z), _volumeElementSpacing.x,
+        _volumeElementSpacing.y, _volumeElementSpacing.z};
+    shadowVolumeKey.insert(shadowVolumeKey.end(), _macrocellOpacities.begin(),
+                           _macrocellOpacities.end());
+    for (const auto& direction : lightDirections)
+        shadowVolumeKey.insert(shadowVolumeKey.end(),
+                               {direction.x, direction.y, direction.z});
+    if (_volumeData.ptr != _shadowVolumeData.ptr ||
+        shadowVolumeKey != _shadowVolumeKey)
+    {
+        _shadowVolumeData = _volumeData;
+        _shadowVolumeKey = shadowVolumeKey;
+        _buildShadowVolumes(lightDirections);
+    }
+    ispc::VolumeRenderer_setShadowVolumes(
+        getIE(), _shadowVolumes.empty() ? nullptr : _shadowVolumes.data(),
+        (ispc::vec3i&)_shadowVolumeDimensions, _shadowVolumeCellSize);
+
+    ispc::VolumeRenderer_setSampling(getIE(), _samplingQuality,
+                                     _adaptiveSampling);
+
+    // Pre-integrated colormap
+    _preIntegration = bool(getParam1i("preIntegration", 0));
+    std::vector<float> colorMap;
+    if (_preIntegration && _transferFunctionDiffuseData &&
+        _transferFunctionSize > 0)
+    {
+        const size_t size = _transferFunctionSize;
+        colorMap.resize(size * 7, 0.f);
+        const size_t nbColors =
+            std::min(size, _transferFunctionDiffuseData->size());
+        memcpy(colorMap.data(), _transferFunctionDiffuseData->data,
+               nbColors * sizeof(vec4f));
+        if (_transferFunctionEmissionData)
+            memcpy(colorMap.data() + size * 4,
+                   _transferFunctionEmissionData->data,
+                   std::min(size, _transferFunctionEmissionData->size()) *
+                       sizeof(vec3f));
+    }
+    if (colorMap != _preIntegratedColorMap)
+    {
+        _preIntegratedColorMap = colorMap;
+        _buildPreIntegrationTable();
+    }
+    ispc::VolumeRenderer_setPreIntegrationTable(
+        getIE(), _preIntegrationTable.empty()
+                     ? nullptr
+                     : (ispc::vec4f*)_preIntegrationTable.data());
+
+    ispc::VolumeRenderer_setMacrocells(
+        getIE(), _macrocells.empty() ? nullptr : _macrocells.data(),
+        (ispc::vec3i&)_macrocellDimensions);
+}
+
+void VolumeRenderer::_prefetchBricks(const FrameBuffer* fb)
+{
+    ManagedObject* camera = getParamObject("camera");
+    if (!camera || !fb)
+        return;
+
+    const vec3f position = camera->getParam3f("pos", vec3f(0.f));
+    const vec3f direction =
+        normalize(camera->getParam3f("dir", vec3f(0.f, 0.f, 1.f)));
+    const vec3f up = camera->getParam3f("up", vec3f(0.f, 1.f, 0.f));
+    const float fovy = camera->getParam1f("fovy", 60.f);
+    const float aspect =
+        camera->getParam1f("aspect", float(fb->size.x) / fb->size.y);
+    const std::vector<float> key{position.x, position.y, position.z,
+                                 direction.x, direction.y, direction.z,
+                                 up.x, up.y, up.z, fovy, aspect};
+    if (key == _prefetchKey)
+        return;
+    _prefetchKey = key;
+
+    // Groups of PREFETCH_GROUP_SIZE^3 bricks are tested against the frustum
+    // with their bounding spheres, and their bricks are queued from the
+    // nearest group, up to the capacity of the cache
+    const vec3f right = normalize(cross(direction, up));
+    const vec3f top = cross(right, direction);
+    const float tanY = std::tan(deg2rad(0.5f * fovy));
+    const float tanX = tanY * aspect;
+    const float scaleX = std::sqrt(1.f + tanX * tanX);
+    const float scaleY = std::sqrt(1.f + tanY * tanY);
+
+    const vec3i& bricks = _brickStore->getBrickDimensions();
+    const vec3i groups =
+        (bricks + vec3i(PREFETCH_GROUP_SIZE - 1)) / PREFETCH_GROUP_SIZE;
+    const vec3f groupSize =
+        _volumeElementSpacing * float(BRICK_SIZE * PREFETCH_GROUP_SIZE);
+    const float radius = 0.5f * length(groupSize);
+
+    std::vector<std::pair<float, vec3i>> visibleGroups;
+    for (int z = 0; z < groups.z; ++z)
+        for (int y = 0; y < groups.y; ++y)
+            for (int x = 0; x < groups.x; ++x)
+            {
+                const vec3f center =
+                    _volumeOffset +
+                    (vec3f(vec3i(x, y, z)) + vec3f(0.5f)) * groupSize;
+                const vec3f v = center - position;
+                const float depth = dot(v, direction);
+                if (depth < -radius ||
+                    std::abs(dot(v, right)) > depth * tanX + radius * scaleX ||
+                    std::abs(dot(v, top)) > depth * tanY + radius * scaleY)
+                    continue;
+                visibleGroups.push_back({length(v), vec3i(x, y, z)});
+            }
+    std::sort(visibleGroups.begin(), visibleGroups.end(),
+              [](const std::pair<float, vec3i>& a,
+                 const std::pair<float, vec3i>& b) {
+                  return a.first < b.first;
+              });
+
+    std::vector<uint32> prefetched;
+    const size_t nbSlots = _brickStore->getNbSlots();
+    for (const auto& group : visibleGroups)
+    {
+        const vec3i lower = group.second * PREFETCH_GROUP_SIZE;
+        const vec3i upper = min(lower + vec3i(PREFETCH_GROUP_SIZE), bricks);
+        for (int z = lower.z; z < upper.z; ++z)
+            for (int y = lower.y; y < upper.y; ++y)
+                for (int x = lower.x; x < upper.x; ++x)
+                    prefetched.push_back(x +
+                                         bricks.x * (y + size_t(bricks.y) * z));
+        if (prefetched.size() >= nbSlots)
+            break;
+    }
+    prefetched.resize(std::min(prefetched.size(), nbSlots));
+    _brickStore->prefetch(prefetched);
+}
+
+void VolumeRenderer::_setPixelFootprint(const FrameBuffer* fb)
+{
+    // Footprint of a pixel, in voxels of the smallest spacing. Orthographic
+    // cameras have a constant footprint given by their height
+    float pixelSize = 0.f;
+    float pixelAngle = 0.f;
+    ManagedObject* camera = getParamObject("camera");
+    if (camera && fb && fb->size.y > 0)
+    {
+        const float voxelSize = reduce_min(_volumeElementSpacing);
+        const float height = camera->getParam1f("height", 0.f);
+        if (height > 0.f)
+            pixelSize = height / fb->size.y / voxelSize;
+        else
+            pixelAngle =
+                2.f *
+                std::tan(deg2rad(0.5f * camera->getParam1f("fovy", 60.f))) /
+                fb->size.y / voxelSize;
+    }
+    ispc::VolumeRenderer_setPixelFootprint(getIE(), pixelSize, pixelAngle);
+}
+
+float VolumeRenderer::renderFrame(FrameBuffer* fb, const uint32 channelFlags)
+{
+    _setPixelFootprint(fb);
+
+    // Missing bricks are sampled from the coarse volume until they are
+    // loaded and moved into the cache, between two frames. Dropped bricks
+    // are prefetched again by the next frame, even if the camera is still
+    if (_brickStore && !_sparseVolume)
+    {
+        _prefetchBricks(fb);
+        bool dropped = false;
+        if (_brickStore->update(dropped))
+            fb->clear(OSP_FB_ACCUM);
+        if (dropped)
+            _prefetchKey.clear();
+    }
+    return Renderer::renderFrame(fb, channelFlags);
 }
 
 VolumeRenderer::VolumeRenderer()
@@ -22,9 +22,22 @@
 #pragma once
 
 #include <common/ispc/renderer/AbstractRenderer.h>
+#include <volume/io/BrickStore.h>
+#include <volume/io/SparseVolume.h>
+
+#include <memory>
 
 namespace brayns
 {
+// Types of the voxels of the volume. Must match VOXEL_TYPE_* in
+// VolumeRenderer.ispc
+enum class VoxelType
+{
+    uint8 = 0,
+    uint16 = 1,
+    float32 = 2
+};
+
 class VolumeRenderer : public ospray::Renderer
 {
 public:
@@ -36,8 +49,29 @@ public:
     */
     std::string toString() const final { return "VolumeRenderer"; }
     void commit() final;
+    float renderFrame(ospray::FrameBuffer* fb,
+                      const ospray::uint32 channelFlags) final;
 
 private:
+    void _quantizeVolume();
+    bool _isSampledFromSource() const;
+    void _buildBricks();
+    void _prefetchBricks(const ospray::FrameBuffer* fb);
+    void _buildGradients();
+    void _buildMipLevels();
+    void _setPixelFootprint(const ospray::FrameBuffer* fb);
+    void _buildMacrocells();
+    void _classifyMacrocells();
+    void _buildSparseVolume();
+    void _classifySparseVolume();
+    std::vector<ospray::uint32> _countVisibleEntries() const;
+    bool _isVisible(const std::vector<ospray::uint32>& visibleEntries,
+                    const ospray::uint8 minValue,
+                    const ospray::uint8 maxValue) const;
+    void _buildPreIntegrationTable();
+    ospray::int32 _getColorMapIndex(const float value) const;
+    void _buildShadowVolumes(const std::vector<ospray::vec3f>& directions);
+
     std::vector<void*> _lightArray;
     void** _lightPtr;
     std::vector<void*> _materialArray;
@@ -57,7 +91,6 @@ private:
     bool _gradientBackgroundEnabled;
     int _randomNumber;
     float _timestamp;
-    int _spp;
 
     // Transfer function
     ospray::Ref<ospray::Data> _transferFunctionDiffuseData;
@@ -74,5 +107,102 @@ private:
     ospray::vec3f _volumeOffset;
     float _volumeEpsilon;
     ospray::int32 _volumeSamplesPerRay;
+    float _samplingQuality;
+    bool _adaptiveSampling;
+
+    // Voxel type. Acceleration structures are built from 8-bit voxels, whose
+    // values are _voxelScale * voxel + _voxelOffset, and volumes of other
+    // types are quantized into _quantizedVolume. Unless volumeQuantization
+    // is 0, the quantized volume is also the one that is rendered
+    VoxelType _voxelType;
+    bool _volumeQuantization;
+    ospray::Ref<ospray::Data> _sourceVolumeData;
+    ospray::Ref<ospray::Data> _quantizedSourceData;
+    VoxelType _quantizedVoxelType{VoxelType::uint8};
+    ospray::vec3i _quantizedVolumeDimensions{0};
+    std::vector<ospray::uint8> _quantizedVolume;
+    ospray::Ref<ospray::Data> _quantizedVolumeData;
+    float _voxelScale{1.f};
+    float _voxelOffset{0.f};
+
+    // Bricked copy of the volume, for a cache locality that does not depend
+    // on the view direction. Bricks are looked up through a page table,
+    // which maps resident volumes to themselves
+    bool _bricking;
+    ospray::Ref<ospray::Data> _brickVolumeData;
+    ospray::vec3i _brickVolumeDimensions{0};
+    ospray::vec3i _brickDimensions{0};
+    std::vector<ospray::uint8> _bricks;
+    std::vector<ospray::uint32> _brickTable;
+
+    // Sparse volume, for mostly empty volumes. It replaces the bricks, mip
+    // levels, gradients and macrocells, and its own tiles are skipped by
+    // rays when they are invisible
+    bool _sparse;
+    ospray::Ref<ospray::Data> _sparseVolumeData;
+    ospray::vec3i _sparseVolumeDimensions{0};
+    std::unique_ptr<SparseVolume> _sparseVolume;
+
+    // Streamed volume. Bricks are loaded in the background, starting with
+    // the ones in the camera frustum, and _brickStoreData wraps the mapped
+    // file for the builders of the other acceleration structures. Those
+    // builders and the coarse copy of the store each read the whole file
+    // once at commit, so streaming bounds the resident memory, not the time
+    // of the first commit
+    std::unique_ptr<BrickStore> _brickStore;
+    ospray::Ref<ospray::Data> _brickStoreData;
+    size_t _volumeCacheSize{0};
+    std::vector<float> _prefetchKey;
+
+    // Mip pyramid, sampled according to the footprint of pixels. Levels are
+    // halved along each axis, and _mipLevels holds a null pointer for the
+    // levels sampled from the volume itself
+    ospray::int32 _volumeMipLevels;
+    ospray::Ref<ospray::Data> _mipVolumeData;
+    ospray::vec3i _mipVolumeDimensions{0};
+    ospray::int32 _mipVolumeLevels{0};
+    std::vector<std::vector<ospray::uint8>> _mipVolumes;
+    std::vector<ospray::uint8*> _mipLevels;
+    std::vector<ospray::vec3i> _mipDimensions;
+
+    // Precomputed normals, from central differences of the voxel values.
+    // They only depend on the volume and replace the neighbour sampling of
+    // the shaded mode
+    bool _gradientVolume;
+    ospray::Ref<ospray::Data> _gradientVolumeData;
+    ospray::vec3i _gradientVolumeDimensions{0};
+    ospray::vec3f _gradientVolumeElementSpacing{0.f};
+    std::vector<ospray::uint8> _gradients;
+
+    // Empty space skipping. The volume is split into macrocells holding the
+    // range of their voxel values, and macrocells in which the transfer
+    // function is fully transparent are skipped by rays
+    ospray::Ref<ospray::Data> _macrocellVolumeData;
+    ospray::vec3i _macrocellVolumeDimensions{0};
+    ospray::vec3i _macrocellDimensions{0};
+    std::vector<ospray::uint8> _macrocellRanges;
+    std::vector<float> _macrocellOpacities;
+    float _macrocellTransferFunctionMinValue{0.f};
+    float _macrocellTransferFunctionRange{0.f};
+    ospray::int32 _macrocellTransferFunctionSize{0};
+    std::vector<ospray::uint8> _macrocells;
+
+    // Pre-integrated colormap, only rebuilt when the colormap changes.
+    // _preIntegratedColorMap holds the diffuse RGBA entries followed by the
+    // emission RGB entries it was built from
+    bool _preIntegration;
+    std::vector<float> _preIntegratedColorMap;
+    std::vector<ospray::vec4f> _preIntegrationTable;
+
+    // Shadow intensity of each light, swept through the volume along the
+    // light direction. Volumes are only used when all lights are
+    // directional, and are only rebuilt when the volume, the colormap
+    // opacities or the light directions change
+    ospray::int32 _shadowVolumeResolution;
+    ospray::Ref<ospray::Data> _shadowVolumeData;
+    std::vector<float> _shadowVolumeKey;
+    ospray::vec3i _shadowVolumeDimensions{0};
+    ospray::int32 _shadowVolumeCellSize{1};
+    std::vector<float> _shadowVolumes;
 };
 }